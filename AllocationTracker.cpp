@@ -0,0 +1,113 @@
+#include "AllocationTracker.h"
+
+#include <cstdlib>
+#include <new>
+
+namespace
+{
+    thread_local order_cache::alloc::AllocationCounters t_counters{};
+
+    void* allocate(std::size_t size)
+    {
+        ++t_counters.allocations;
+        t_counters.bytes += size;
+        if (void* p{std::malloc(size == 0 ? 1 : size)})
+        {
+            return p;
+        }
+        throw std::bad_alloc{};
+    }
+
+    void* allocateAligned(std::size_t size, std::align_val_t alignment)
+    {
+        ++t_counters.allocations;
+        t_counters.bytes += size;
+        const auto align{static_cast<std::size_t>(alignment)};
+#if defined(_MSC_VER)
+        void* p{_aligned_malloc(size == 0 ? 1 : size, align)};
+#else
+        // aligned_alloc wants the size to be a multiple of the alignment
+        const auto rounded{(size == 0 ? align : (size + align - 1) / align * align)};
+        void* p{std::aligned_alloc(align, rounded)};
+#endif
+        if (p != nullptr)
+        {
+            return p;
+        }
+        throw std::bad_alloc{};
+    }
+
+    void deallocate(void* p) noexcept
+    {
+        if (p != nullptr)
+        {
+            ++t_counters.deallocations;
+            std::free(p);
+        }
+    }
+
+    void deallocateAligned(void* p) noexcept
+    {
+        if (p != nullptr)
+        {
+            ++t_counters.deallocations;
+#if defined(_MSC_VER)
+            _aligned_free(p);
+#else
+            std::free(p);
+#endif
+        }
+    }
+}
+
+namespace order_cache::alloc
+{
+    AllocationCounters threadCounters() noexcept
+    {
+        return t_counters;
+    }
+}
+
+void* operator new(std::size_t size) { return allocate(size); }
+void* operator new[](std::size_t size) { return allocate(size); }
+
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept
+{
+    try { return allocate(size); }
+    catch (...) { return nullptr; }
+}
+
+void* operator new[](std::size_t size, const std::nothrow_t&) noexcept
+{
+    try { return allocate(size); }
+    catch (...) { return nullptr; }
+}
+
+void* operator new(std::size_t size, std::align_val_t alignment) { return allocateAligned(size, alignment); }
+void* operator new[](std::size_t size, std::align_val_t alignment) { return allocateAligned(size, alignment); }
+
+void* operator new(std::size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept
+{
+    try { return allocateAligned(size, alignment); }
+    catch (...) { return nullptr; }
+}
+
+void* operator new[](std::size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept
+{
+    try { return allocateAligned(size, alignment); }
+    catch (...) { return nullptr; }
+}
+
+void operator delete(void* p) noexcept { deallocate(p); }
+void operator delete[](void* p) noexcept { deallocate(p); }
+void operator delete(void* p, std::size_t) noexcept { deallocate(p); }
+void operator delete[](void* p, std::size_t) noexcept { deallocate(p); }
+void operator delete(void* p, const std::nothrow_t&) noexcept { deallocate(p); }
+void operator delete[](void* p, const std::nothrow_t&) noexcept { deallocate(p); }
+
+void operator delete(void* p, std::align_val_t) noexcept { deallocateAligned(p); }
+void operator delete[](void* p, std::align_val_t) noexcept { deallocateAligned(p); }
+void operator delete(void* p, std::size_t, std::align_val_t) noexcept { deallocateAligned(p); }
+void operator delete[](void* p, std::size_t, std::align_val_t) noexcept { deallocateAligned(p); }
+void operator delete(void* p, std::align_val_t, const std::nothrow_t&) noexcept { deallocateAligned(p); }
+void operator delete[](void* p, std::align_val_t, const std::nothrow_t&) noexcept { deallocateAligned(p); }
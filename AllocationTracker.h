@@ -0,0 +1,40 @@
+#pragma once
+
+#include <cstdint>
+
+namespace order_cache::alloc
+{
+    // Global operator new/delete calls made by the current thread, counted by the replacement
+    // operators in AllocationTracker.cpp. Only binaries linking that file are tracked.
+    struct AllocationCounters
+    {
+        uint64_t allocations{0};
+        uint64_t deallocations{0};
+        uint64_t bytes{0};
+
+        [[nodiscard]] AllocationCounters operator-(const AllocationCounters& other) const noexcept
+        {
+            return {allocations - other.allocations, deallocations - other.deallocations, bytes - other.bytes};
+        }
+    };
+
+    [[nodiscard]] AllocationCounters threadCounters() noexcept;
+
+    // Allocations made by this thread since the scope was opened
+    class AllocationScope final
+    {
+    public:
+        AllocationScope() noexcept : m_start(threadCounters())
+        {
+        }
+
+        [[nodiscard]] AllocationCounters delta() const noexcept { return threadCounters() - m_start; }
+
+        [[nodiscard]] uint64_t allocations() const noexcept { return delta().allocations; }
+
+        [[nodiscard]] uint64_t bytes() const noexcept { return delta().bytes; }
+
+    private:
+        AllocationCounters m_start;
+    };
+}
@@ -0,0 +1,339 @@
+#pragma once
+
+#include "AllocationTracker.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#if defined(_MSC_VER)
+#include <intrin.h>
+#else
+#include <x86intrin.h>
+#endif
+#define ORDER_CACHE_BENCH_HAS_TSC 1
+#endif
+
+#if defined(__linux__)
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#define ORDER_CACHE_BENCH_HAS_PERF_EVENTS 1
+#endif
+
+namespace order_cache::bench
+{
+    using Clock = std::chrono::steady_clock;
+
+#ifdef ORDER_CACHE_BENCH_HAS_TSC
+    // time stamp counter ticks, constant rate reference cycles on every CPU of the last decade
+    static constexpr const char* CYCLE_UNIT{"tsc"};
+
+    [[nodiscard]] inline uint64_t cycleCount() noexcept { return __rdtsc(); }
+#else
+    static constexpr const char* CYCLE_UNIT{"ns"};
+
+    [[nodiscard]] inline uint64_t cycleCount() noexcept
+    {
+        return static_cast<uint64_t>(
+            std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now().time_since_epoch()).count());
+    }
+#endif
+
+    // keeps the compiler from discarding a computed value
+    template <typename T>
+    inline void doNotOptimize(const T& value) noexcept
+    {
+#if defined(__GNUC__) || defined(__clang__)
+        asm volatile("" : : "r,m"(value) : "memory");
+#else
+        static volatile const void* sink;
+        sink = &value;
+#endif
+    }
+
+    // Last level cache misses of the calling thread through perf_event_open, user space only. Unavailable
+    // without a hardware PMU (most virtual machines) or when perf_event_paranoid forbids it.
+    class CacheMissCounter final
+    {
+    public:
+        CacheMissCounter()
+        {
+#ifdef ORDER_CACHE_BENCH_HAS_PERF_EVENTS
+            perf_event_attr attr{};
+            attr.type = PERF_TYPE_HARDWARE;
+            attr.size = sizeof(attr);
+            attr.config = PERF_COUNT_HW_CACHE_MISSES;
+            attr.exclude_kernel = 1;
+            attr.exclude_hv = 1;
+            m_fd = static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0));
+#endif
+        }
+
+        CacheMissCounter(const CacheMissCounter&) = delete;
+        CacheMissCounter& operator=(const CacheMissCounter&) = delete;
+
+        ~CacheMissCounter()
+        {
+#ifdef ORDER_CACHE_BENCH_HAS_PERF_EVENTS
+            if (m_fd >= 0)
+            {
+                close(m_fd);
+            }
+#endif
+        }
+
+        [[nodiscard]] bool available() const noexcept { return m_fd >= 0; }
+
+        // running total, 0 when unavailable
+        [[nodiscard]] uint64_t read() const noexcept
+        {
+            uint64_t count{0};
+#ifdef ORDER_CACHE_BENCH_HAS_PERF_EVENTS
+            if (m_fd >= 0 && ::read(m_fd, &count, sizeof(count)) != static_cast<ssize_t>(sizeof(count)))
+            {
+                count = 0;
+            }
+#endif
+            return count;
+        }
+
+    private:
+        int m_fd{-1};
+    };
+
+    [[nodiscard]] inline uint64_t elapsedNs(Clock::time_point start, Clock::time_point end) noexcept
+    {
+        return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count());
+    }
+
+    // Per-operation latency samples collected across the measured runs of one workload
+    class LatencyRecorder final
+    {
+    public:
+        void reserve(std::size_t samples) { m_samples.reserve(samples); }
+
+        void record(uint64_t ns)
+        {
+            m_samples.emplace_back(ns);
+            m_sorted = false;
+        }
+
+        void clear() noexcept
+        {
+            m_samples.clear();
+            m_sorted = false;
+            m_allocations = alloc::AllocationCounters{};
+        }
+
+        void recordAllocations(const alloc::AllocationCounters& delta) noexcept
+        {
+            m_allocations.allocations += delta.allocations;
+            m_allocations.deallocations += delta.deallocations;
+            m_allocations.bytes += delta.bytes;
+        }
+
+        [[nodiscard]] const alloc::AllocationCounters& allocations() const noexcept { return m_allocations; }
+
+        [[nodiscard]] std::size_t size() const noexcept { return m_samples.size(); }
+
+        [[nodiscard]] uint64_t total() const noexcept
+        {
+            uint64_t sum{0};
+            for (const auto ns : m_samples)
+            {
+                sum += ns;
+            }
+            return sum;
+        }
+
+        // sorts the samples in place on first use after recording
+        [[nodiscard]] uint64_t percentile(double p)
+        {
+            if (m_samples.empty())
+            {
+                return 0;
+            }
+            if (!m_sorted)
+            {
+                std::sort(m_samples.begin(), m_samples.end());
+                m_sorted = true;
+            }
+            const auto rank{static_cast<std::size_t>(p / 100.0 * static_cast<double>(m_samples.size() - 1) + 0.5)};
+            return m_samples[std::min(rank, m_samples.size() - 1)];
+        }
+
+    private:
+        std::vector<uint64_t> m_samples;
+        bool m_sorted{false};
+        alloc::AllocationCounters m_allocations{};
+    };
+
+    struct BenchmarkResult
+    {
+        std::string name;
+        uint64_t operations{0};
+        double nsPerOp{0};
+        double bestRunNsPerOp{0};
+        double opsPerSec{0};
+        uint64_t p50{0};
+        uint64_t p90{0};
+        uint64_t p99{0};
+        uint64_t p999{0};
+        uint64_t max{0};
+        double allocationsPerOp{0};
+        double bytesPerOp{0};
+    };
+
+    struct BenchmarkOptions
+    {
+        unsigned int warmupRuns{1};
+        unsigned int measuredRuns{5};
+    };
+
+    // A workload prepares fresh state in `setup` (not timed) and then performs its operations in `run`,
+    // timing every public call it is interested in through the recorder.
+    struct Workload
+    {
+        std::string name;
+        std::function<void()> setup;
+        std::function<void(LatencyRecorder&)> run;
+        std::function<void()> teardown{};
+    };
+
+    // Times a single call and records it together with the heap allocations it made, the clock read
+    // itself is reported by `timerOverheadNs`
+    template <typename F>
+    inline void timed(LatencyRecorder& recorder, F&& f)
+    {
+        const auto allocationsBefore{alloc::threadCounters()};
+        const auto start{Clock::now()};
+        f();
+        const auto end{Clock::now()};
+        recorder.recordAllocations(alloc::threadCounters() - allocationsBefore);
+        recorder.record(elapsedNs(start, end));
+    }
+
+    [[nodiscard]] inline double timerOverheadNs()
+    {
+        constexpr int ITERATIONS{100'000};
+        LatencyRecorder recorder;
+        recorder.reserve(ITERATIONS);
+        for (int i = 0; i < ITERATIONS; ++i)
+        {
+            timed(recorder, [] {});
+        }
+        return static_cast<double>(recorder.percentile(50));
+    }
+
+    [[nodiscard]] inline BenchmarkResult runWorkload(const Workload& workload, const BenchmarkOptions& options)
+    {
+        LatencyRecorder discarded;
+        for (unsigned int i = 0; i < options.warmupRuns; ++i)
+        {
+            workload.setup();
+            workload.run(discarded);
+            if (workload.teardown)
+            {
+                workload.teardown();
+            }
+            discarded.clear();
+        }
+
+        LatencyRecorder recorder;
+        BenchmarkResult result{workload.name};
+        double bestRun{0};
+        for (unsigned int i = 0; i < options.measuredRuns; ++i)
+        {
+            workload.setup();
+            const auto samplesBefore{recorder.size()};
+            const auto totalBefore{recorder.total()};
+            workload.run(recorder);
+            if (workload.teardown)
+            {
+                workload.teardown();
+            }
+
+            const auto ops{recorder.size() - samplesBefore};
+            if (ops != 0)
+            {
+                const auto runNs{static_cast<double>(recorder.total() - totalBefore)};
+                const auto runNsPerOp{runNs / static_cast<double>(ops)};
+                bestRun = (bestRun == 0) ? runNsPerOp : std::min(bestRun, runNsPerOp);
+            }
+        }
+
+        result.operations = recorder.size();
+        if (result.operations != 0)
+        {
+            result.nsPerOp = static_cast<double>(recorder.total()) / static_cast<double>(result.operations);
+            result.bestRunNsPerOp = bestRun;
+            result.opsPerSec = result.nsPerOp > 0 ? 1e9 / result.nsPerOp : 0;
+            result.p50 = recorder.percentile(50);
+            result.p90 = recorder.percentile(90);
+            result.p99 = recorder.percentile(99);
+            result.p999 = recorder.percentile(99.9);
+            result.max = recorder.percentile(100);
+
+            const auto ops{static_cast<double>(result.operations)};
+            result.allocationsPerOp = static_cast<double>(recorder.allocations().allocations) / ops;
+            result.bytesPerOp = static_cast<double>(recorder.allocations().bytes) / ops;
+        }
+        return result;
+    }
+
+    inline void printHeader(std::ostream& os, bool csv)
+    {
+        if (csv)
+        {
+            os << "workload,operations,ns_per_op,best_run_ns_per_op,ops_per_sec,p50_ns,p90_ns,p99_ns,p99_9_ns,max_ns,"
+                "allocs_per_op,bytes_per_op\n";
+            return;
+        }
+        os << std::left << std::setw(22) << "workload"
+            << std::right << std::setw(12) << "ops"
+            << std::setw(12) << "ns/op"
+            << std::setw(12) << "best ns/op"
+            << std::setw(14) << "ops/sec"
+            << std::setw(10) << "p50"
+            << std::setw(10) << "p90"
+            << std::setw(10) << "p99"
+            << std::setw(10) << "p99.9"
+            << std::setw(12) << "max"
+            << std::setw(10) << "allocs/op"
+            << std::setw(10) << "bytes/op" << '\n';
+    }
+
+    inline void printResult(std::ostream& os, const BenchmarkResult& r, bool csv)
+    {
+        if (csv)
+        {
+            os << r.name << ',' << r.operations << ',' << r.nsPerOp << ',' << r.bestRunNsPerOp << ','
+                << r.opsPerSec << ',' << r.p50 << ',' << r.p90 << ',' << r.p99 << ',' << r.p999 << ',' << r.max
+                << ',' << r.allocationsPerOp << ',' << r.bytesPerOp << '\n';
+            return;
+        }
+        os << std::left << std::setw(22) << r.name
+            << std::right << std::setw(12) << r.operations
+            << std::fixed << std::setprecision(1)
+            << std::setw(12) << r.nsPerOp
+            << std::setw(12) << r.bestRunNsPerOp
+            << std::setprecision(0)
+            << std::setw(14) << r.opsPerSec
+            << std::setw(10) << r.p50
+            << std::setw(10) << r.p90
+            << std::setw(10) << r.p99
+            << std::setw(10) << r.p999
+            << std::setw(12) << r.max
+            << std::setprecision(2)
+            << std::setw(10) << r.allocationsPerOp
+            << std::setprecision(0)
+            << std::setw(10) << r.bytesPerOp << '\n';
+    }
+}
@@ -0,0 +1,474 @@
+#pragma once
+
+#include "MemoryUsage.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <functional>
+#include <memory>
+#include <new>
+#include <string>
+#include <string_view>
+#include <utility>
+
+namespace order_cache::storage
+{
+    // Open addressing string keyed map with Robin Hood probing. Keys and values live inline in one slot
+    // array, so a key short enough for the small string buffer costs no allocation, and lookups by any
+    // string_view walk a short run of slots next to the home slot. A parallel array of 4 byte probe
+    // metadata (distance from the home slot and a hash tag) filters the run before any key is compared;
+    // a lookup stops at the first slot closer to its home than the probe, which bounds misses too.
+    //
+    // Growing does not rehash in one go: the full table is kept as the old table and every later insert
+    // migrates a bounded number of its slots into the new one, Redis style, while lookups check both.
+    // An insert migrates about MIGRATION_STEP_SLOTS slots, never the whole table, and the new arrays are
+    // not initialized up front; lookups and erases never migrate. reserve() and shrinkToFit() still
+    // rehash synchronously.
+    //
+    // Inserts and erases move entries, pointers returned by find() and tryEmplace() are valid until the
+    // next insert or erase.
+    template <typename Value>
+    class FlatHashMap final
+    {
+    public:
+        static constexpr std::size_t MIN_SLOTS{16};
+        // old table slots emptied or skipped per insert while growing. A large step keeps the migrating
+        // inserts well under one in a hundred, so they stay out of the p99 of a growing map
+        static constexpr std::size_t MIGRATION_STEP_SLOTS{4096};
+
+        struct Entry
+        {
+            std::string key;
+            Value value{};
+        };
+
+        FlatHashMap() = default;
+        FlatHashMap(FlatHashMap&&) noexcept = default;
+        FlatHashMap& operator=(FlatHashMap&&) noexcept = default;
+        FlatHashMap(const FlatHashMap&) = delete;
+        FlatHashMap& operator=(const FlatHashMap&) = delete;
+
+        [[nodiscard]] Value* find(std::string_view key) noexcept
+        {
+            return const_cast<Value*>(std::as_const(*this).find(key));
+        }
+
+        [[nodiscard]] const Value* find(std::string_view key) const noexcept
+        {
+            if (empty())
+            {
+                return nullptr;
+            }
+            const auto hash{_hash(key)};
+            if (const auto slot{m_table.find(key, hash)}; slot != NOT_FOUND)
+            {
+                return &m_table.entries[slot].value;
+            }
+            if (const auto slot{m_old.find(key, hash)}; slot != NOT_FOUND)
+            {
+                return &m_old.entries[slot].value;
+            }
+            return nullptr;
+        }
+
+        // the value stored for `key` and whether it was inserted, value initialized, by this call
+        std::pair<Value*, bool> tryEmplace(std::string_view key)
+        {
+            _migrateStep();
+            if (auto* value{find(key)})
+            {
+                return {value, false};
+            }
+            if ((m_table.size + 1) * MAX_LOAD_DENOMINATOR > m_table.slots * MAX_LOAD_NUMERATOR)
+            {
+                _grow();
+            }
+            return {m_table.insert(Entry{std::string{key}, Value{}}, _hash(key)), true};
+        }
+
+        bool erase(std::string_view key) noexcept
+        {
+            const auto hash{_hash(key)};
+            if (const auto slot{m_table.find(key, hash)}; slot != NOT_FOUND)
+            {
+                m_table.eraseAt(slot);
+                return true;
+            }
+            if (const auto slot{m_old.find(key, hash)}; slot != NOT_FOUND)
+            {
+                m_old.eraseAt(slot);
+                return true;
+            }
+            return false;
+        }
+
+        // sizes the slot array so `keys` entries fit without growing, rehashing everything right away
+        void reserve(std::size_t keys)
+        {
+            const auto slots{_slotsFor(keys)};
+            if (keys != 0 && slots > m_table.slots)
+            {
+                _rehash(slots);
+            }
+        }
+
+        // rehashes into the smallest slot array that holds the current keys, an empty map holds no memory
+        void shrinkToFit()
+        {
+            if (empty())
+            {
+                m_table = Table{};
+                m_old = Table{};
+                return;
+            }
+            if (const auto slots{_slotsFor(size())}; slots < m_table.slots || rehashing())
+            {
+                _rehash(slots);
+            }
+        }
+
+        template <typename F>
+        void forEach(F&& f)
+        {
+            m_table.forEach(f);
+            m_old.forEach(f);
+        }
+
+        template <typename F>
+        void forEach(F&& f) const
+        {
+            m_table.forEach(f);
+            m_old.forEach(f);
+        }
+
+        [[nodiscard]] std::size_t size() const noexcept { return m_table.size + m_old.size; }
+
+        [[nodiscard]] bool empty() const noexcept { return size() == 0; }
+
+        // allocated slots, the old table included while it is being migrated
+        [[nodiscard]] std::size_t slotCount() const noexcept { return m_table.slots + m_old.slots; }
+
+        [[nodiscard]] bool rehashing() const noexcept { return m_old.slots != 0; }
+
+        [[nodiscard]] double loadFactor() const noexcept
+        {
+            return slotCount() == 0 ? 0.0 : static_cast<double>(size()) / static_cast<double>(slotCount());
+        }
+
+        [[nodiscard]] static constexpr double maxLoadFactor() noexcept
+        {
+            return static_cast<double>(MAX_LOAD_NUMERATOR) / static_cast<double>(MAX_LOAD_DENOMINATOR);
+        }
+
+        // slots a lookup of each key touches in its table, 1 when the key sits in its home slot
+        template <typename F>
+        void forEachProbeLength(F&& f) const
+        {
+            m_table.forEachProbeLength(f);
+            m_old.forEachProbeLength(f);
+        }
+
+        // slot arrays, heap owned by the keys and values is not included
+        [[nodiscard]] std::size_t slotMemory() const noexcept
+        {
+            return m_table.memoryUsage() + m_old.memoryUsage();
+        }
+
+        // payloads of the keys too long for the small string buffer
+        [[nodiscard]] std::size_t keyMemory() const noexcept
+        {
+            std::size_t bytes{0};
+            forEach([&](const std::string& key, const Value&) { bytes += memory::stringHeapBytes(key); });
+            return bytes;
+        }
+
+    private:
+        static constexpr std::size_t NOT_FOUND{~std::size_t{0}};
+        // Robin Hood keeps probe runs short up to high loads, 7/8 leaves one free slot in eight
+        static constexpr std::size_t MAX_LOAD_NUMERATOR{7};
+        static constexpr std::size_t MAX_LOAD_DENOMINATOR{8};
+
+        struct Meta
+        {
+            uint16_t distance{0}; // 0 for an empty slot, otherwise the probe distance from the home slot + 1
+            uint16_t tag{0}; // high bits of the hash, compared before the key
+        };
+
+        // One power of two slot array. The metadata comes zeroed from calloc, so a large fresh table is
+        // backed by untouched pages; entries are only constructed in occupied slots.
+        struct Table
+        {
+            Meta* meta{nullptr};
+            Entry* entries{nullptr};
+            std::size_t slots{0};
+            std::size_t mask{0};
+            std::size_t size{0};
+
+            Table() = default;
+
+            explicit Table(std::size_t slotCount) : slots(slotCount), mask(slotCount - 1)
+            {
+                meta = static_cast<Meta*>(std::calloc(slots, sizeof(Meta)));
+                if (meta == nullptr)
+                {
+                    throw std::bad_alloc{};
+                }
+                try
+                {
+                    entries = std::allocator<Entry>{}.allocate(slots);
+                }
+                catch (...)
+                {
+                    std::free(meta);
+                    throw;
+                }
+            }
+
+            Table(Table&& other) noexcept { _swap(other); }
+
+            Table& operator=(Table&& other) noexcept
+            {
+                Table{std::move(other)}._swap(*this);
+                return *this;
+            }
+
+            Table(const Table&) = delete;
+            Table& operator=(const Table&) = delete;
+
+            ~Table()
+            {
+                if (meta == nullptr)
+                {
+                    return;
+                }
+                // a drained table is released without a scan
+                for (std::size_t i = 0; size != 0 && i < slots; ++i)
+                {
+                    if (meta[i].distance != 0)
+                    {
+                        std::destroy_at(&entries[i]);
+                        --size;
+                    }
+                }
+                std::allocator<Entry>{}.deallocate(entries, slots);
+                std::free(meta);
+            }
+
+            [[nodiscard]] std::size_t find(std::string_view key, std::size_t hash) const noexcept
+            {
+                if (size == 0)
+                {
+                    return NOT_FOUND;
+                }
+                const auto tag{_tag(hash)};
+                auto slot{hash & mask};
+                for (uint16_t distance = 1;; ++distance, slot = (slot + 1) & mask)
+                {
+                    const auto current{meta[slot]};
+                    if (current.distance < distance)
+                    {
+                        return NOT_FOUND;
+                    }
+                    if (current.distance == distance && current.tag == tag && entries[slot].key == key)
+                    {
+                        return slot;
+                    }
+                }
+            }
+
+            // places an entry known to be absent, displacing entries closer to their home slot than the probe
+            Value* insert(Entry entry, std::size_t hash) noexcept
+            {
+                Meta carried{1, _tag(hash)};
+                Value* inserted{nullptr};
+                for (auto slot{hash & mask};; slot = (slot + 1) & mask, ++carried.distance)
+                {
+                    auto& current{meta[slot]};
+                    if (current.distance == 0)
+                    {
+                        current = carried;
+                        ::new (static_cast<void*>(&entries[slot])) Entry{std::move(entry)};
+                        ++size;
+                        return inserted != nullptr ? inserted : &entries[slot].value;
+                    }
+                    if (current.distance < carried.distance)
+                    {
+                        std::swap(current, carried);
+                        std::swap(entries[slot], entry);
+                        if (inserted == nullptr)
+                        {
+                            inserted = &entries[slot].value;
+                        }
+                    }
+                }
+            }
+
+            // backward shift: pulls the rest of the run one slot closer to home instead of a tombstone
+            void eraseAt(std::size_t slot) noexcept
+            {
+                for (auto next{(slot + 1) & mask}; meta[next].distance > 1; slot = next, next = (next + 1) & mask)
+                {
+                    meta[slot] = Meta{static_cast<uint16_t>(meta[next].distance - 1), meta[next].tag};
+                    entries[slot] = std::move(entries[next]);
+                }
+                meta[slot] = Meta{};
+                std::destroy_at(&entries[slot]);
+                --size;
+            }
+
+            // empties a slot without touching its run, only valid once the whole run is being emptied
+            void vacate(std::size_t slot) noexcept
+            {
+                meta[slot] = Meta{};
+                std::destroy_at(&entries[slot]);
+                --size;
+            }
+
+            template <typename F>
+            void forEach(F& f) const
+            {
+                for (std::size_t i = 0; i < slots; ++i)
+                {
+                    if (meta[i].distance != 0)
+                    {
+                        f(entries[i].key, entries[i].value);
+                    }
+                }
+            }
+
+            template <typename F>
+            void forEach(F& f)
+            {
+                for (std::size_t i = 0; i < slots; ++i)
+                {
+                    if (meta[i].distance != 0)
+                    {
+                        f(std::as_const(entries[i].key), entries[i].value);
+                    }
+                }
+            }
+
+            template <typename F>
+            void forEachProbeLength(F& f) const
+            {
+                for (std::size_t i = 0; i < slots; ++i)
+                {
+                    if (meta[i].distance != 0)
+                    {
+                        f(static_cast<std::size_t>(meta[i].distance));
+                    }
+                }
+            }
+
+            [[nodiscard]] std::size_t memoryUsage() const noexcept
+            {
+                return memory::heapBlockBytes(slots * sizeof(Meta)) + memory::heapBlockBytes(slots * sizeof(Entry));
+            }
+
+        private:
+            void _swap(Table& other) noexcept
+            {
+                std::swap(meta, other.meta);
+                std::swap(entries, other.entries);
+                std::swap(slots, other.slots);
+                std::swap(mask, other.mask);
+                std::swap(size, other.size);
+            }
+        };
+
+        Table m_table;
+        Table m_old; // being migrated into m_table after a growth, empty otherwise
+        std::size_t m_migrated{0}; // next old table slot to migrate, counts up from an empty slot
+
+        [[nodiscard]] static std::size_t _hash(std::string_view key) noexcept
+        {
+            return std::hash<std::string_view>{}(key);
+        }
+
+        [[nodiscard]] static uint16_t _tag(std::size_t hash) noexcept
+        {
+            return static_cast<uint16_t>(hash >> (8 * sizeof(std::size_t) - 16));
+        }
+
+        [[nodiscard]] static std::size_t _slotsFor(std::size_t keys) noexcept
+        {
+            auto slots{MIN_SLOTS};
+            while (slots * MAX_LOAD_NUMERATOR < keys * MAX_LOAD_DENOMINATOR)
+            {
+                slots *= 2;
+            }
+            return slots;
+        }
+
+        void _grow()
+        {
+            // the previous growth is normally long migrated, finish it rather than keep three tables
+            _migrate(m_old.slots);
+            m_old = std::exchange(m_table, Table{std::max(MIN_SLOTS, m_table.slots * 2)});
+            if (m_old.size == 0)
+            {
+                m_old = Table{};
+                return;
+            }
+            // start on an empty slot, so no run is split by the wrap around
+            m_migrated = 0;
+            while (m_old.meta[m_migrated].distance != 0)
+            {
+                ++m_migrated;
+            }
+        }
+
+        void _migrateStep() noexcept
+        {
+            if (rehashing())
+            {
+                _migrate(MIGRATION_STEP_SLOTS);
+            }
+        }
+
+        // Moves the entries of about `budget` old table slots, a whole run at a time: a lookup never
+        // probes past the empty slot ending its run, so emptying complete runs keeps every key still in
+        // the old table reachable without shifting anything. A run started is finished even over budget,
+        // runs stay short below the load limit.
+        void _migrate(std::size_t budget) noexcept
+        {
+            while (budget != 0 && m_old.size != 0)
+            {
+                auto slot{m_migrated & m_old.mask};
+                for (; m_old.meta[slot].distance != 0; slot = ++m_migrated & m_old.mask)
+                {
+                    auto& entry{m_old.entries[slot]};
+                    const auto hash{_hash(entry.key)};
+                    m_table.insert(std::move(entry), hash);
+                    m_old.vacate(slot);
+                    budget -= budget != 0;
+                }
+                ++m_migrated;
+                budget -= budget != 0;
+            }
+            if (rehashing() && m_old.size == 0)
+            {
+                m_old = Table{};
+            }
+        }
+
+        void _rehash(std::size_t slots)
+        {
+            auto current{std::exchange(m_table, Table{slots})};
+            auto old{std::exchange(m_old, Table{})};
+            for (auto* table : {&old, &current})
+            {
+                for (std::size_t i = 0; i < table->slots; ++i)
+                {
+                    if (table->meta[i].distance != 0)
+                    {
+                        auto& entry{table->entries[i]};
+                        const auto hash{_hash(entry.key)};
+                        m_table.insert(std::move(entry), hash);
+                    }
+                }
+            }
+        }
+    };
+}
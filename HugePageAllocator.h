@@ -0,0 +1,188 @@
+#pragma once
+
+#include "MemoryUsage.h"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <vector>
+
+#if defined(ORDER_CACHE_HUGE_PAGES) && defined(__linux__)
+#include <sys/mman.h>
+#endif
+
+namespace order_cache::alloc
+{
+#if defined(ORDER_CACHE_HUGE_PAGES) && defined(__linux__)
+    static constexpr bool HUGE_PAGES_ENABLED{true};
+#else
+    static constexpr bool HUGE_PAGES_ENABLED{false};
+#endif
+
+    static constexpr std::size_t HUGE_PAGE_BYTES{2u << 20};
+
+    // Mappings made for large arrays since start, by the page size the kernel agreed to
+    struct HugePageCounters
+    {
+        std::atomic<uint64_t> explicitMappings{0}; // MAP_HUGETLB, from the hugetlbfs pool
+        std::atomic<uint64_t> transparentMappings{0}; // regular mapping advised with MADV_HUGEPAGE
+        std::atomic<uint64_t> regularMappings{0}; // neither was available, 4K pages
+    };
+
+    [[nodiscard]] inline HugePageCounters& hugePageCounters() noexcept
+    {
+        static HugePageCounters counters;
+        return counters;
+    }
+
+    // Runtime switch for builds with huge page support, read when a container is created
+    [[nodiscard]] inline std::atomic<bool>& hugePagesRequested() noexcept
+    {
+        static std::atomic<bool> requested{HUGE_PAGES_ENABLED};
+        return requested;
+    }
+
+    namespace detail
+    {
+        [[nodiscard]] constexpr std::size_t roundToHugePages(std::size_t bytes) noexcept
+        {
+            return (bytes + HUGE_PAGE_BYTES - 1) / HUGE_PAGE_BYTES * HUGE_PAGE_BYTES;
+        }
+
+#if defined(ORDER_CACHE_HUGE_PAGES) && defined(__linux__)
+        // tries the hugetlbfs pool first, then a 2M aligned anonymous mapping advised for transparent huge
+        // pages; the kernel silently keeps 4K pages when neither is configured
+        [[nodiscard]] inline void* mapHugePages(std::size_t bytes)
+        {
+            auto& counters{hugePageCounters()};
+            constexpr int PROTECTION{PROT_READ | PROT_WRITE};
+            constexpr int FLAGS{MAP_PRIVATE | MAP_ANONYMOUS};
+
+            if (void* p{mmap(nullptr, bytes, PROTECTION, FLAGS | MAP_HUGETLB, -1, 0)}; p != MAP_FAILED)
+            {
+                counters.explicitMappings.fetch_add(1, std::memory_order_relaxed);
+                return p;
+            }
+
+            // over-map by one huge page and cut the unaligned ends, THP only backs aligned 2M ranges
+            const auto mapped{bytes + HUGE_PAGE_BYTES};
+            void* raw{mmap(nullptr, mapped, PROTECTION, FLAGS, -1, 0)};
+            if (raw == MAP_FAILED)
+            {
+                throw std::bad_alloc{};
+            }
+            const auto begin{reinterpret_cast<uintptr_t>(raw)};
+            const auto aligned{(begin + HUGE_PAGE_BYTES - 1) / HUGE_PAGE_BYTES * HUGE_PAGE_BYTES};
+            if (aligned != begin)
+            {
+                munmap(raw, aligned - begin);
+            }
+            if (const auto tail{begin + mapped - (aligned + bytes)}; tail != 0)
+            {
+                munmap(reinterpret_cast<void*>(aligned + bytes), tail);
+            }
+
+            auto* p{reinterpret_cast<void*>(aligned)};
+            if (madvise(p, bytes, MADV_HUGEPAGE) == 0)
+            {
+                counters.transparentMappings.fetch_add(1, std::memory_order_relaxed);
+            }
+            else
+            {
+                counters.regularMappings.fetch_add(1, std::memory_order_relaxed);
+            }
+            return p;
+        }
+
+        inline void unmapHugePages(void* p, std::size_t bytes) noexcept
+        {
+            munmap(p, bytes);
+        }
+#else
+        [[nodiscard]] inline void* mapHugePages(std::size_t)
+        {
+            throw std::bad_alloc{};
+        }
+
+        inline void unmapHugePages(void*, std::size_t) noexcept
+        {
+        }
+#endif
+    }
+
+    // std::allocator replacement for the large id-indexed arrays: blocks of at least one huge page are
+    // mapped directly and rounded up to whole huge pages, smaller ones come from operator new. Whether
+    // huge pages are used is fixed when the allocator is created, so every block is released the way it
+    // was obtained even if the runtime switch changes in between.
+    template <typename T>
+    class HugePageAllocator
+    {
+    public:
+        using value_type = T;
+
+        HugePageAllocator() noexcept : m_hugePages(HUGE_PAGES_ENABLED && hugePagesRequested().load())
+        {
+        }
+
+        template <typename U>
+        HugePageAllocator(const HugePageAllocator<U>& other) noexcept : m_hugePages(other.usesHugePages())
+        {
+        }
+
+        [[nodiscard]] T* allocate(std::size_t n)
+        {
+            const auto bytes{n * sizeof(T)};
+            if (_mapped(bytes))
+            {
+                return static_cast<T*>(detail::mapHugePages(detail::roundToHugePages(bytes)));
+            }
+            return static_cast<T*>(::operator new(bytes));
+        }
+
+        void deallocate(T* p, std::size_t n) noexcept
+        {
+            const auto bytes{n * sizeof(T)};
+            if (_mapped(bytes))
+            {
+                detail::unmapHugePages(p, detail::roundToHugePages(bytes));
+                return;
+            }
+            ::operator delete(p);
+        }
+
+        [[nodiscard]] bool usesHugePages() const noexcept { return m_hugePages; }
+
+        template <typename U>
+        [[nodiscard]] bool operator==(const HugePageAllocator<U>& other) const noexcept
+        {
+            return m_hugePages == other.usesHugePages();
+        }
+
+        template <typename U>
+        [[nodiscard]] bool operator!=(const HugePageAllocator<U>& other) const noexcept
+        {
+            return !(*this == other);
+        }
+
+    private:
+        bool m_hugePages;
+
+        [[nodiscard]] bool _mapped(std::size_t bytes) const noexcept
+        {
+            return m_hugePages && bytes >= HUGE_PAGE_BYTES;
+        }
+    };
+}
+
+namespace order_cache::memory
+{
+    // mapped blocks occupy whole huge pages
+    template <typename T>
+    [[nodiscard]] std::size_t vectorHeapBytes(const std::vector<T, alloc::HugePageAllocator<T>>& v) noexcept
+    {
+        const auto bytes{v.capacity() * sizeof(T)};
+        return v.get_allocator().usesHugePages() && bytes >= alloc::HUGE_PAGE_BYTES ?
+            alloc::detail::roundToHugePages(bytes) : heapBlockBytes(bytes);
+    }
+}
@@ -0,0 +1,331 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <iomanip>
+#include <limits>
+#include <ostream>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+#if defined(ORDER_CACHE_LATENCY_USE_TSC) && (defined(__x86_64__) || defined(_M_X64))
+#if !defined(_MSC_VER)
+#include <x86intrin.h>
+#endif
+#define ORDER_CACHE_LATENCY_TSC_AVAILABLE 1
+#endif
+
+namespace order_cache::metrics
+{
+#ifdef ORDER_CACHE_LATENCY_HISTOGRAMS
+    static constexpr bool LATENCY_HISTOGRAMS_ENABLED{true};
+#else
+    static constexpr bool LATENCY_HISTOGRAMS_ENABLED{false};
+#endif
+
+    [[nodiscard]] inline unsigned int highestBit(uint64_t value) noexcept
+    {
+#if defined(_MSC_VER)
+        unsigned long index{0};
+        _BitScanReverse64(&index, value);
+        return static_cast<unsigned int>(index);
+#else
+        return 63u - static_cast<unsigned int>(__builtin_clzll(value));
+#endif
+    }
+
+    // HDR style log-linear histogram of nanosecond values: every power of two range is split into
+    // SUB_BUCKETS linear buckets, so any recorded value is reported within 1 / SUB_BUCKETS (~3%).
+    class LatencyHistogram final
+    {
+    public:
+        static constexpr unsigned int SUB_BUCKET_BITS{5};
+        static constexpr uint64_t SUB_BUCKETS{1u << SUB_BUCKET_BITS};
+        static constexpr std::size_t BUCKETS{(64 - SUB_BUCKET_BITS + 1) * SUB_BUCKETS};
+
+        void record(uint64_t ns) noexcept
+        {
+            ++m_counts[bucketOf(ns)];
+            ++m_count;
+            m_sum += ns;
+            m_min = std::min(m_min, ns);
+            m_max = std::max(m_max, ns);
+        }
+
+        void reset() noexcept { *this = LatencyHistogram{}; }
+
+        void merge(const LatencyHistogram& other) noexcept
+        {
+            for (std::size_t i = 0; i < BUCKETS; ++i)
+            {
+                m_counts[i] += other.m_counts[i];
+            }
+            m_count += other.m_count;
+            m_sum += other.m_sum;
+            m_min = std::min(m_min, other.m_min);
+            m_max = std::max(m_max, other.m_max);
+        }
+
+        [[nodiscard]] uint64_t count() const noexcept { return m_count; }
+        [[nodiscard]] uint64_t min() const noexcept { return m_count == 0 ? 0 : m_min; }
+        [[nodiscard]] uint64_t max() const noexcept { return m_max; }
+
+        [[nodiscard]] double mean() const noexcept
+        {
+            return m_count == 0 ? 0.0 : static_cast<double>(m_sum) / static_cast<double>(m_count);
+        }
+
+        // highest value of the bucket holding the p-th percentile, clamped to the recorded max
+        [[nodiscard]] uint64_t percentile(double p) const noexcept
+        {
+            if (m_count == 0)
+            {
+                return 0;
+            }
+            const auto clamped{std::min(std::max(p, 0.0), 100.0)};
+            auto rank{static_cast<uint64_t>(clamped / 100.0 * static_cast<double>(m_count) + 0.5)};
+            rank = std::max<uint64_t>(rank, 1);
+
+            uint64_t seen{0};
+            for (std::size_t i = 0; i < BUCKETS; ++i)
+            {
+                seen += m_counts[i];
+                if (seen >= rank)
+                {
+                    return std::min(std::max(bucketUpperBound(i), m_min), m_max);
+                }
+            }
+            return m_max;
+        }
+
+        [[nodiscard]] static std::size_t bucketOf(uint64_t value) noexcept
+        {
+            if (value < SUB_BUCKETS)
+            {
+                return static_cast<std::size_t>(value);
+            }
+            const auto shift{highestBit(value) - SUB_BUCKET_BITS};
+            const auto sub{(value >> shift) & (SUB_BUCKETS - 1)};
+            return static_cast<std::size_t>((shift + 1) * SUB_BUCKETS + sub);
+        }
+
+        [[nodiscard]] static uint64_t bucketLowerBound(std::size_t bucket) noexcept
+        {
+            if (bucket < SUB_BUCKETS)
+            {
+                return bucket;
+            }
+            const auto shift{bucket / SUB_BUCKETS - 1};
+            const auto sub{bucket % SUB_BUCKETS};
+            return (SUB_BUCKETS + sub) << shift;
+        }
+
+        [[nodiscard]] static uint64_t bucketUpperBound(std::size_t bucket) noexcept
+        {
+            if (bucket < SUB_BUCKETS)
+            {
+                return bucket;
+            }
+            const auto shift{bucket / SUB_BUCKETS - 1};
+            return bucketLowerBound(bucket) + ((uint64_t{1} << shift) - 1);
+        }
+
+    private:
+        std::array<uint64_t, BUCKETS> m_counts{};
+        uint64_t m_count{0};
+        uint64_t m_sum{0};
+        uint64_t m_min{std::numeric_limits<uint64_t>::max()};
+        uint64_t m_max{0};
+    };
+
+    enum class Operation : uint32_t
+    {
+        AddOrder = 0,
+        CancelOrder,
+        CancelOrdersForUser,
+        CancelOrdersForSecIdWithMinimumQty,
+        GetMatchingSizeForSecurity,
+        GetAllOrders,
+        CancelOrdersForSecIdAndCompany,
+        CancelOrdersForCompany,
+        CancelOrders,
+        Count,
+    };
+
+    [[nodiscard]] inline const char* operationName(Operation op) noexcept
+    {
+        switch (op)
+        {
+        case Operation::AddOrder: return "addOrder";
+        case Operation::CancelOrder: return "cancelOrder";
+        case Operation::CancelOrdersForUser: return "cancelOrdersForUser";
+        case Operation::CancelOrdersForSecIdWithMinimumQty: return "cancelOrdersForSecIdWithMinimumQty";
+        case Operation::GetMatchingSizeForSecurity: return "getMatchingSizeForSecurity";
+        case Operation::GetAllOrders: return "getAllOrders";
+        case Operation::CancelOrdersForSecIdAndCompany: return "cancelOrdersForSecIdAndCompany";
+        case Operation::CancelOrdersForCompany: return "cancelOrdersForCompany";
+        case Operation::CancelOrders: return "cancelOrders";
+        default: return "unknown";
+        }
+    }
+
+    class LatencyHistograms final
+    {
+    public:
+        static constexpr std::size_t OPERATIONS{static_cast<std::size_t>(Operation::Count)};
+
+        [[nodiscard]] LatencyHistogram& operator[](Operation op) noexcept
+        {
+            return m_histograms[static_cast<std::size_t>(op)];
+        }
+
+        [[nodiscard]] const LatencyHistogram& operator[](Operation op) const noexcept
+        {
+            return m_histograms[static_cast<std::size_t>(op)];
+        }
+
+        void reset() noexcept
+        {
+            for (auto& histogram : m_histograms)
+            {
+                histogram.reset();
+            }
+        }
+
+    private:
+        std::array<LatencyHistogram, OPERATIONS> m_histograms{};
+    };
+
+    // The histograms owned by a cache; when disabled it holds nothing and reads as an empty snapshot
+    template <bool Enabled = LATENCY_HISTOGRAMS_ENABLED>
+    class OperationLatencies final
+    {
+    public:
+        [[nodiscard]] LatencyHistogram& operator[](Operation op) noexcept { return m_histograms[op]; }
+
+        [[nodiscard]] const LatencyHistograms& histograms() const noexcept { return m_histograms; }
+
+        void reset() noexcept { m_histograms.reset(); }
+
+    private:
+        LatencyHistograms m_histograms;
+    };
+
+    template <>
+    class OperationLatencies<false> final
+    {
+    public:
+        // shared by every cache, nothing records into it
+        [[nodiscard]] const LatencyHistograms& histograms() const noexcept
+        {
+            static const LatencyHistograms empty{};
+            return empty;
+        }
+
+        void reset() noexcept
+        {
+        }
+    };
+
+    // Monotonic timestamps in nanoseconds, the TSC flavour converts cycles with a ratio calibrated
+    // once against steady_clock
+    class LatencyClock final
+    {
+    public:
+#ifdef ORDER_CACHE_LATENCY_TSC_AVAILABLE
+        [[nodiscard]] static uint64_t ticks() noexcept { return __rdtsc(); }
+
+        [[nodiscard]] static uint64_t toNs(uint64_t ticks) noexcept
+        {
+            return static_cast<uint64_t>(static_cast<double>(ticks) * nsPerTick());
+        }
+
+        [[nodiscard]] static double nsPerTick() noexcept
+        {
+            static const double ratio{_calibrate()};
+            return ratio;
+        }
+
+    private:
+        [[nodiscard]] static double _calibrate() noexcept
+        {
+            using namespace std::chrono;
+            const auto startTime{steady_clock::now()};
+            const auto startTicks{__rdtsc()};
+            while (steady_clock::now() - startTime < milliseconds{10})
+            {
+            }
+            const auto ns{duration_cast<nanoseconds>(steady_clock::now() - startTime).count()};
+            const auto ticks{__rdtsc() - startTicks};
+            return ticks == 0 ? 1.0 : static_cast<double>(ns) / static_cast<double>(ticks);
+        }
+#else
+        [[nodiscard]] static uint64_t ticks() noexcept
+        {
+            return static_cast<uint64_t>(std::chrono::steady_clock::now().time_since_epoch().count());
+        }
+
+        [[nodiscard]] static uint64_t toNs(uint64_t ticks) noexcept
+        {
+            using namespace std::chrono;
+            return static_cast<uint64_t>(duration_cast<nanoseconds>(steady_clock::duration{ticks}).count());
+        }
+#endif
+    };
+
+    // Records the lifetime of the guard into the operation histogram, compiles to nothing when disabled
+    template <bool Enabled = LATENCY_HISTOGRAMS_ENABLED>
+    class ScopedLatency final
+    {
+    public:
+        ScopedLatency(OperationLatencies<Enabled>& histograms, Operation op) noexcept
+            : m_histogram(histograms[op]),
+              m_start(LatencyClock::ticks())
+        {
+        }
+
+        ScopedLatency(const ScopedLatency&) = delete;
+        ScopedLatency& operator=(const ScopedLatency&) = delete;
+
+        ~ScopedLatency() { m_histogram.record(LatencyClock::toNs(LatencyClock::ticks() - m_start)); }
+
+    private:
+        LatencyHistogram& m_histogram;
+        uint64_t m_start;
+    };
+
+    template <>
+    class ScopedLatency<false> final
+    {
+    public:
+        ScopedLatency(OperationLatencies<false>&, Operation) noexcept
+        {
+        }
+    };
+
+    inline void printLatencyHistograms(std::ostream& os, const LatencyHistograms& histograms)
+    {
+        os << std::left << std::setw(36) << "operation" << std::right
+            << std::setw(12) << "count" << std::setw(10) << "mean"
+            << std::setw(10) << "p50" << std::setw(10) << "p99" << std::setw(10) << "p99.9"
+            << std::setw(12) << "max" << '\n';
+        for (std::size_t i = 0; i < LatencyHistograms::OPERATIONS; ++i)
+        {
+            const auto op{static_cast<Operation>(i)};
+            const auto& h{histograms[op]};
+            if (h.count() == 0)
+            {
+                continue;
+            }
+            os << std::left << std::setw(36) << operationName(op) << std::right
+                << std::setw(12) << h.count()
+                << std::fixed << std::setprecision(0) << std::setw(10) << h.mean()
+                << std::setw(10) << h.percentile(50) << std::setw(10) << h.percentile(99)
+                << std::setw(10) << h.percentile(99.9) << std::setw(12) << h.max() << '\n';
+        }
+    }
+}
@@ -0,0 +1,107 @@
+#pragma once
+
+#include <cstddef>
+#include <functional>
+#include <iomanip>
+#include <ostream>
+#include <string>
+
+namespace order_cache::memory
+{
+    // Heap footprint of an allocation of `size` bytes: glibc style chunks carry an 8 byte header, are
+    // 16 byte aligned and never smaller than 32 bytes. Other allocators are close enough for sizing.
+    [[nodiscard]] constexpr std::size_t heapBlockBytes(std::size_t size) noexcept
+    {
+        if (size == 0)
+        {
+            return 0;
+        }
+        constexpr std::size_t HEADER{sizeof(std::size_t)};
+        constexpr std::size_t ALIGNMENT{16};
+        constexpr std::size_t MIN_CHUNK{32};
+        const auto chunk{(size + HEADER + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT};
+        return chunk < MIN_CHUNK ? MIN_CHUNK : chunk;
+    }
+
+    // true when `data` points into the object at `owner`, i.e. a string using its small buffer
+    [[nodiscard]] inline bool isInside(const void* data, const void* owner, std::size_t ownerSize) noexcept
+    {
+        const auto* p{static_cast<const char*>(data)};
+        const auto* begin{static_cast<const char*>(owner)};
+        const std::less<const char*> less;
+        return !less(p, begin) && less(p, begin + ownerSize);
+    }
+
+    // Out of line payload of a string, zero while it fits the small string buffer
+    [[nodiscard]] inline std::size_t stringHeapBytes(const std::string& s) noexcept
+    {
+        return isInside(s.data(), &s, sizeof(std::string)) ? 0 : heapBlockBytes(s.capacity() + 1);
+    }
+
+    // Heap blocks owned by a std::vector, sized by capacity rather than size
+    template <typename Vector>
+    [[nodiscard]] std::size_t vectorHeapBytes(const Vector& v) noexcept
+    {
+        return heapBlockBytes(v.capacity() * sizeof(typename Vector::value_type));
+    }
+
+    struct StorageMemory
+    {
+        std::size_t slotHandles{0}; // security and segment position of every slot, up to the vector capacity
+        std::size_t coldSlots{0}; // order id and user strings and user list links of every slot
+        std::size_t stringPayloads{0}; // heap payloads of the cold strings too long for the small buffer
+        std::size_t aliveBitmap{0}; // one presence bit per slot
+        std::size_t segments{0}; // per security chunks of hot fields
+        std::size_t companyBooks{0}; // per security company books and their lookup slots
+        std::size_t overflow{0}; // buckets and nodes of the orders kept outside the id window
+        std::size_t symbols{0}; // interned securities and companies
+
+        [[nodiscard]] std::size_t total() const noexcept
+        {
+            return slotHandles + coldSlots + stringPayloads + aliveBitmap + segments + companyBooks + overflow + symbols;
+        }
+    };
+
+    struct IndexMemory
+    {
+        std::size_t slots{0}; // open addressing slot array: probe metadata, inline keys and list ends
+        std::size_t keyStrings{0}; // payloads of the keys too long for the small string buffer
+
+        [[nodiscard]] std::size_t total() const noexcept { return slots + keyStrings; }
+    };
+
+    struct MemoryUsage
+    {
+        StorageMemory storage{};
+        IndexMemory userIndex{};
+        std::size_t qtyIndex{0}; // quantity levels of every security side, the lists run through the cold slots
+
+        [[nodiscard]] std::size_t total() const noexcept { return storage.total() + userIndex.total() + qtyIndex; }
+    };
+
+    inline void printMemoryUsage(std::ostream& os, const MemoryUsage& usage, std::size_t liveOrders)
+    {
+        const auto line{
+            [&](const char* name, std::size_t bytes)
+            {
+                os << "  " << std::left << std::setw(28) << name << std::right << std::setw(14) << bytes
+                    << std::fixed << std::setprecision(1) << std::setw(10)
+                    << (liveOrders == 0 ? 0.0 : static_cast<double>(bytes) / static_cast<double>(liveOrders))
+                    << " B/order\n";
+            }
+        };
+        os << "memory (live orders=" << liveOrders << "):\n";
+        line("storage slot handles", usage.storage.slotHandles);
+        line("storage cold slots", usage.storage.coldSlots);
+        line("storage string payloads", usage.storage.stringPayloads);
+        line("storage alive bitmap", usage.storage.aliveBitmap);
+        line("storage security segments", usage.storage.segments);
+        line("storage company books", usage.storage.companyBooks);
+        line("storage overflow orders", usage.storage.overflow);
+        line("storage symbols", usage.storage.symbols);
+        line("user index slots", usage.userIndex.slots);
+        line("user index keys", usage.userIndex.keyStrings);
+        line("qty index levels", usage.qtyIndex);
+        line("total", usage.total());
+    }
+}
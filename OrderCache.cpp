@@ -1,49 +1,73 @@
 #include "OrderCache.h"
 #include "OrderValidator.h"
+#include "Tracing.h"
 
 #include <sstream>
 #include <charconv>
 #include <algorithm>
 
 using namespace order_cache::validator;
+using order_cache::metrics::Operation;
+using order_cache::metrics::ScopedLatency;
+using order_cache::trace::ScopedTrace;
 
-OrderCache::OrderCache() : m_orderStorage(ORDERS_STORAGE_CAPACITY)
-{
-    m_userOrderIds.reserve(USER_ORDER_IDS_MAP_CAPACITY);
-    m_securityOrderIds.reserve(SECURITY_ORDER_IDS_MAP_CAPACITY);
-}
+OrderCache::OrderCache() = default;
 
 void OrderCache::addOrder(Order order)
 {
-    if (auto err{OrderValidator::validateOrder(order)})
-    {
-        std::stringstream message;
-        message << "Invalid order : " << OrderValidator::errorToString(err.value());
-        throw std::invalid_argument(message.str());
-    }
+    ScopedLatency latency{m_latencyHistograms, Operation::AddOrder};
+    ScopedTrace trace{"addOrder"};
+    _countOperation(Operation::AddOrder);
 
-    const auto idValue{_idToIndex(order.orderIdSv())};
-    if (!idValue.has_value())
+    std::optional<uint64_t> idValue;
     {
-        throw std::invalid_argument("Failed to parse order ID value due adding : " + order.orderId());
+        ScopedTrace validateTrace{"validate"};
+        if (auto err{OrderValidator::validateOrder(order)})
+        {
+            std::stringstream message;
+            message << "Invalid order : " << OrderValidator::errorToString(err.value());
+            throw std::invalid_argument(message.str());
+        }
+
+        idValue = _idToIndex(order.orderIdSv());
+        if (!idValue.has_value())
+        {
+            throw std::invalid_argument("Failed to parse order ID value due adding : " + order.orderId());
+        }
     }
 
     if (m_orderStorage.hasOrder(idValue.value()))
     {
+        ++m_duplicateOrdersIgnored;
         return;
     }
 
     const auto index{idValue.value()};
-    m_orderStorage.addOrder(std::move(order), index);
     {
-        const auto& tmp{m_orderStorage.getOrder(index)};
-        _addOrderId(m_userOrderIds, tmp.userSv(), index);
-        _addOrderId(m_securityOrderIds, tmp.securityIdSv(), index);
+        ScopedTrace storageTrace{"storageInsert"};
+        m_orderStorage.addOrder(std::move(order), index);
+    }
+    if (m_userIndexBuilt || m_qtyIndexBuilt)
+    {
+        ScopedTrace indexTrace{"indexUpdate"};
+        if (m_userIndexBuilt)
+        {
+            _linkUserOrder(index);
+        }
+        if (m_qtyIndexBuilt)
+        {
+            _linkQtyOrder(index);
+        }
     }
+    ++m_ordersAdded;
 }
 
 void OrderCache::cancelOrder(const std::string& orderId)
 {
+    ScopedLatency latency{m_latencyHistograms, Operation::CancelOrder};
+    ScopedTrace trace{"cancelOrder"};
+    _countOperation(Operation::CancelOrder);
+
     const auto idValue{_idToIndex(orderId)};
     if (!idValue.has_value())
     {
@@ -60,121 +84,515 @@ void OrderCache::cancelOrder(const std::string& orderId)
 
 void OrderCache::cancelOrdersForUser(const std::string& user)
 {
-    if (auto userOrdersIt{m_userOrderIds.find(user)}; userOrdersIt != m_userOrderIds.end())
+    ScopedLatency latency{m_latencyHistograms, Operation::CancelOrdersForUser};
+    ScopedTrace trace{"cancelOrdersForUser"};
+    _countOperation(Operation::CancelOrdersForUser);
+
+    if (!m_userIndexBuilt)
     {
-        auto orderIds{userOrdersIt->second};
-        for (const auto index : orderIds)
-        {
-            if (!m_orderStorage.hasOrder(index))
-            {
-                continue;
-            }
-            _cancelOrderByIndex(index);
-        }
+        _buildUserIndex();
+    }
+    m_userIndexUsed = true;
+
+    const auto* userOrders{m_userOrders.find(user)};
+    if (userOrders == nullptr)
+    {
+        return;
+    }
+    // cancelling unlinks the order and erases the drained entry, read the next link first
+    for (auto index{userOrders->head}; index != order_cache::storage::NO_ORDER;)
+    {
+        const auto next{m_orderStorage.userLinks(index).next};
+        _cancelOrderByIndex(index);
+        index = next;
     }
 }
 
 void OrderCache::cancelOrdersForSecIdWithMinimumQty(const std::string& securityId, unsigned int minQty)
 {
+    ScopedLatency latency{m_latencyHistograms, Operation::CancelOrdersForSecIdWithMinimumQty};
+    ScopedTrace trace{"cancelOrdersForSecIdWithMinimumQty"};
+    _countOperation(Operation::CancelOrdersForSecIdWithMinimumQty);
+
     if (minQty == 0)
     {
         return;
     }
 
-    auto securityOrdersIt{m_securityOrderIds.find(securityId)};
-    if (securityOrdersIt == m_securityOrderIds.end())
+    const auto security{m_orderStorage.securities().find(securityId)};
+    if (!security.has_value())
     {
         return;
     }
+    // never builds the quantity index, the wide ranges this is called with are cheapest to scan; an index
+    // built by cancelOrders is still walked when the range is narrow enough
+    OrderFilter filter;
+    filter.security = security.value();
+    filter.minQty = minQty;
+    _cancelMatching(filter);
+}
 
-    auto orderIds{securityOrdersIt->second};
-    for (const auto index : orderIds)
+unsigned int OrderCache::getMatchingSizeForSecurity(const std::string& securityId)
+{
+    ScopedLatency latency{m_latencyHistograms, Operation::GetMatchingSizeForSecurity};
+    ScopedTrace trace{"getMatchingSizeForSecurity"};
+    _countOperation(Operation::GetMatchingSizeForSecurity);
+
+    const auto* segment{m_orderStorage.segment(securityId)};
+    if (segment == nullptr || segment->empty())
     {
-        if (!m_orderStorage.hasOrder(index) || m_orderStorage.getOrder(index).qty() < minQty)
-        {
-            continue;
-        }
-        _cancelOrderByIndex(index);
+        return 0;
     }
+
+    return _matchingSize(_aggregateCompanyVolumes(*segment));
 }
 
-unsigned int OrderCache::getMatchingSizeForSecurity(const std::string& securityId)
+OrderCache::SecurityVolume OrderCache::_aggregateCompanyVolumes(const order_cache::storage::SecuritySegment& segment)
+{
+    ScopedTrace trace{"aggregate"};
+    SecurityVolume volume;
+    segment.forEachBook([&](const order_cache::storage::CompanyBook& book)
+    {
+        volume.totalBuy += static_cast<int64_t>(book.buyQty);
+        volume.totalSell += static_cast<int64_t>(book.sellQty);
+        volume.maxCompanyVolume = std::max(volume.maxCompanyVolume, book.buyQty + book.sellQty);
+    });
+    return volume;
+}
+
+void OrderCache::_cancelBook(const order_cache::storage::SecuritySegment& segment,
+                             const order_cache::storage::CompanyBook& book)
+{
+    // removing an order unlinks it from the book, and a move into its hole relinks the moved order
+    while (book.head != order_cache::storage::NO_POSITION)
+    {
+        _cancelOrderByIndex(segment[book.head].orderIndex);
+    }
+}
+
+std::pair<const order_cache::storage::SecuritySegment*, const order_cache::storage::CompanyBook*>
+OrderCache::_companyBook(std::string_view securityId, std::string_view company) const
 {
-    const auto secIt{m_securityOrderIds.find(securityId)};
-    if (secIt == m_securityOrderIds.end())
+    const auto* segment{m_orderStorage.segment(securityId)};
+    const auto symbol{m_orderStorage.companies().find(company)};
+    if (segment == nullptr || !symbol.has_value())
+    {
+        return {segment, nullptr};
+    }
+    return {segment, segment->book(symbol.value())};
+}
+
+unsigned int OrderCache::_matchingSize(const SecurityVolume& volume) noexcept
+{
+    const auto totalBuy{volume.totalBuy};
+    const auto totalSell{volume.totalSell};
+    if (totalBuy == 0 || totalSell == 0)
     {
         return 0;
     }
 
-    struct CompanyVolume
+    const auto Vmax{static_cast<int64_t>(volume.maxCompanyVolume)};
+    const auto exBuy{std::max(static_cast<int64_t>(0), Vmax - totalSell)};
+    const auto exSell{std::max(static_cast<int64_t>(0), Vmax - totalBuy)};
+    const auto matchBuy{std::max(static_cast<int64_t>(0), totalBuy - exBuy)};
+    const auto matchSell{std::max(static_cast<int64_t>(0), totalSell - exSell)};
+    return static_cast<unsigned int>(std::min(matchBuy, matchSell));
+}
+
+OrderCache::CompanyVolume OrderCache::getCompanyVolumeForSecurity(const std::string& securityId,
+                                                                 const std::string& company) const
+{
+    const auto [segment, book]{_companyBook(securityId, company)};
+    return book == nullptr ? CompanyVolume{} : CompanyVolume{book->buyQty, book->sellQty, book->orders};
+}
+
+std::vector<Order> OrderCache::getOrdersForSecIdAndCompany(const std::string& securityId,
+                                                           const std::string& company) const
+{
+    std::vector<Order> result;
+    const auto [segment, book]{_companyBook(securityId, company)};
+    if (book == nullptr)
+    {
+        return result;
+    }
+    result.reserve(book->orders);
+    for (auto position{book->head}; position != order_cache::storage::NO_POSITION;
+         position = (*segment)[position].nextInBook)
+    {
+        result.emplace_back(m_orderStorage.order((*segment)[position].orderIndex));
+    }
+    return result;
+}
+
+void OrderCache::cancelOrdersForSecIdAndCompany(const std::string& securityId, const std::string& company)
+{
+    ScopedLatency latency{m_latencyHistograms, Operation::CancelOrdersForSecIdAndCompany};
+    ScopedTrace trace{"cancelOrdersForSecIdAndCompany"};
+    _countOperation(Operation::CancelOrdersForSecIdAndCompany);
+
+    const auto [segment, book]{_companyBook(securityId, company)};
+    if (book != nullptr)
     {
-        std::string_view companyName{};
-        uint64_t buy{0};
-        uint64_t sell{0};
+        _cancelBook(*segment, *book);
+    }
+}
+
+void OrderCache::cancelOrdersForCompany(const std::string& company)
+{
+    ScopedLatency latency{m_latencyHistograms, Operation::CancelOrdersForCompany};
+    ScopedTrace trace{"cancelOrdersForCompany"};
+    _countOperation(Operation::CancelOrdersForCompany);
 
-        bool operator<(std::string_view name) const
+    const auto symbol{m_orderStorage.companies().find(company)};
+    if (!symbol.has_value())
+    {
+        return;
+    }
+    // a drained book leaves the company's security list, so the head is the next security every time
+    for (auto security{m_orderStorage.firstSecurityOf(symbol.value())}; security != order_cache::storage::NO_SYMBOL;
+         security = m_orderStorage.firstSecurityOf(symbol.value()))
+    {
+        const auto& segment{m_orderStorage.segments()[security]};
+        _cancelBook(segment, *segment.book(symbol.value()));
+    }
+}
+
+void OrderCache::cancelOrders(const CancelFilter& filter)
+{
+    ScopedLatency latency{m_latencyHistograms, Operation::CancelOrders};
+    ScopedTrace trace{"cancelOrders"};
+    _countOperation(Operation::CancelOrders);
+
+    using order_cache::storage::Side;
+
+    OrderFilter resolved;
+    if (!filter.side.empty())
+    {
+        if (filter.side != BUY_SIDE && filter.side != SELL_SIDE)
         {
-            return companyName < name;
+            throw std::invalid_argument("Invalid side in cancel filter : " + filter.side);
         }
-    };
+        resolved.anySide = false;
+        resolved.side = filter.side == BUY_SIDE ? Side::Buy : Side::Sell;
+    }
 
-    const auto ids{secIt->second};
-    int64_t totalBuy{0};
-    int64_t totalSell{0};
-    uint64_t maxVolume{0};
+    const auto security{m_orderStorage.securities().find(filter.securityId)};
+    if (!security.has_value() || filter.minQty > filter.maxQty)
+    {
+        return;
+    }
+    resolved.security = security.value();
+    resolved.minQty = filter.minQty;
+    resolved.maxQty = filter.maxQty;
+    resolved.user = filter.user;
+    if (!filter.company.empty())
+    {
+        const auto company{m_orderStorage.companies().find(filter.company)};
+        if (!company.has_value())
+        {
+            return;
+        }
+        resolved.company = company.value();
+    }
 
-    std::vector<CompanyVolume> companyOrders;
-    companyOrders.reserve(ids.size());
+    // like cancelOrdersForUser, the first query needing an index pays for its build
+    if (!filter.user.empty() && !m_userIndexBuilt)
+    {
+        _buildUserIndex();
+    }
+    if (resolved.narrowsQtyOrSide() && !m_qtyIndexBuilt)
+    {
+        _buildQtyIndex();
+    }
+    _cancelMatching(resolved);
+}
+
+void OrderCache::_cancelMatching(const OrderFilter& filter)
+{
+    using order_cache::storage::NO_ORDER;
+    using order_cache::storage::NO_POSITION;
+    using order_cache::storage::NO_SYMBOL;
+    using order_cache::storage::Side;
+
+    const auto& segment{m_orderStorage.segments()[filter.security]};
+
+    // the list with the fewest orders to visit is walked, unless scanning the whole segment is cheaper
+    enum class Path
+    {
+        Scan,
+        Book,
+        User,
+        Qty,
+    };
+    auto path{Path::Scan};
+    auto candidates{std::numeric_limits<uint64_t>::max()};
 
-    for (const auto index : ids)
+    const order_cache::storage::CompanyBook* book{nullptr};
+    if (filter.company != NO_SYMBOL)
     {
-        if (!m_orderStorage.hasOrder(index))
+        book = segment.book(filter.company);
+        if (book == nullptr || book->orders == 0)
+        {
+            return;
+        }
+        if (book->orders < candidates)
         {
-            continue;
+            path = Path::Book;
+            candidates = book->orders;
         }
+    }
 
-        auto& order{m_orderStorage.getOrder(index)};
-        CompanyVolume tmp{order.companySv()};
+    const UserOrders* userOrders{nullptr};
+    if (!filter.user.empty())
+    {
+        m_userIndexUsed = true;
+        userOrders = m_userOrders.find(filter.user);
+        if (userOrders == nullptr)
+        {
+            return;
+        }
+        if (userOrders->count < candidates)
         {
-            auto isBuy{order.sideSv() == BUY_SIDE};
-            auto& total{isBuy ? totalBuy : totalSell};
-            auto& companyVolume{isBuy ? tmp.buy : tmp.sell};
-            total += order.qty();
-            companyVolume += order.qty();
+            path = Path::User;
+            candidates = userOrders->count;
         }
+    }
 
-        auto it{std::lower_bound(companyOrders.begin(), companyOrders.end(), order.companySv())}; //, cmp)};
-        if (it != companyOrders.end() && it->companyName == order.companySv())
+    // the levels of the selected sides within [minQty, maxQty], a run starting at a tree lookup. The next
+    // level is taken before visiting, cancelling the last order of a level erases it
+    const auto forEachLevel{
+        [&](auto&& visit)
         {
-            it->buy += tmp.buy;
-            it->sell += tmp.sell;
-            maxVolume = std::max(maxVolume, it->buy + it->sell);
+            for (const auto side : {Side::Buy, Side::Sell})
+            {
+                if (!filter.anySide && side != filter.side)
+                {
+                    continue;
+                }
+                auto& levels{_qtyLevels(filter.security, side)};
+                for (auto level{levels.lower_bound(filter.minQty)};
+                     level != levels.end() && level->first <= filter.maxQty;)
+                {
+                    visit((level++)->second);
+                }
+            }
         }
-        else
+    };
+    if (filter.narrowsQtyOrSide() && m_qtyIndexBuilt)
+    {
+        m_qtyIndexUsed = true;
+        uint64_t inRange{0};
+        forEachLevel([&](const QtyLevel& level) { inRange += level.count; });
+        if (inRange < candidates)
         {
-            maxVolume = std::max(maxVolume, tmp.buy + tmp.sell);
-            companyOrders.insert(it, tmp);
+            path = Path::Qty;
+            candidates = inRange;
         }
     }
 
-    if (totalBuy == 0 || totalSell == 0)
+    if (path != Path::Scan && candidates * LINKED_VISIT_COST >= segment.size())
     {
-        return 0;
+        path = Path::Scan;
     }
 
-    const auto Vmax{static_cast<int64_t>(maxVolume)};
-    const auto exBuy{std::max(static_cast<int64_t>(0), Vmax - totalSell)};
-    const auto exSell{std::max(static_cast<int64_t>(0), Vmax - totalBuy)};
-    const auto matchBuy{std::max(static_cast<int64_t>(0), totalBuy - exBuy)};
-    const auto matchSell{std::max(static_cast<int64_t>(0), totalSell - exSell)};
-    return std::min(matchBuy, matchSell);
+    // every path reads the next link before cancelling, a cancel unlinks the order from all of its lists
+    switch (path)
+    {
+    case Path::Scan:
+        // walking backwards, a removal only moves the last entry into the hole and that one was already visited
+        for (auto position{segment.size()}; position-- > 0;)
+        {
+            const auto& order{segment[position]};
+            if (_matches(order, filter))
+            {
+                _cancelOrderByIndex(order.orderIndex);
+            }
+        }
+        break;
+    case Path::Book:
+        // a removal moves another entry of the segment, so the book is walked by order index
+        for (auto index{segment[book->head].orderIndex}; index != NO_ORDER;)
+        {
+            const auto& order{m_orderStorage.hot(index)};
+            const auto next{order.nextInBook == NO_POSITION ? NO_ORDER : segment[order.nextInBook].orderIndex};
+            if (_matches(order, filter))
+            {
+                _cancelOrderByIndex(index);
+            }
+            index = next;
+        }
+        break;
+    case Path::User:
+        for (auto index{userOrders->head}; index != NO_ORDER;)
+        {
+            const auto next{m_orderStorage.userLinks(index).next};
+            if (m_orderStorage.security(index) == filter.security && _matches(m_orderStorage.hot(index), filter))
+            {
+                _cancelOrderByIndex(index);
+            }
+            index = next;
+        }
+        break;
+    case Path::Qty:
+        forEachLevel(
+            [&](const QtyLevel& level)
+            {
+                for (auto index{level.head}; index != NO_ORDER;)
+                {
+                    const auto next{m_orderStorage.qtyLinks(index).next};
+                    if (_matches(m_orderStorage.hot(index), filter))
+                    {
+                        _cancelOrderByIndex(index);
+                    }
+                    index = next;
+                }
+            });
+        break;
+    }
+}
+
+bool OrderCache::_matches(const order_cache::storage::HotOrder& order, const OrderFilter& filter) const
+{
+    return (filter.anySide || order.side == filter.side) && order.qty >= filter.minQty &&
+        order.qty <= filter.maxQty &&
+        (filter.company == order_cache::storage::NO_SYMBOL || order.company == filter.company) &&
+        (filter.user.empty() || m_orderStorage.cold(order.orderIndex).user == filter.user);
 }
 
 std::vector<Order> OrderCache::getAllOrders() const
 {
+    ScopedLatency latency{m_latencyHistograms, Operation::GetAllOrders};
+    ScopedTrace trace{"getAllOrders"};
+    _countOperation(Operation::GetAllOrders);
     return m_orderStorage.getAllOrders();
 }
 
+order_cache::stats::OrderCacheStats OrderCache::stats() const
+{
+    order_cache::stats::OrderCacheStats result;
+    result.operationCounts = m_operationCounts;
+    result.ordersAdded = m_ordersAdded;
+    result.ordersCancelled = m_ordersCancelled;
+    result.duplicateOrdersIgnored = m_duplicateOrdersIgnored;
+    result.liveOrders = m_orderStorage.size();
+    result.storageSlots = m_orderStorage.slots();
+    result.storageCapacity = m_orderStorage.capacity();
+    result.userIndex = _indexStats(m_userOrders);
+    result.userIndex.built = m_userIndexBuilt;
+    result.securityIndex = _securityIndexStats();
+    for (const auto& sides : m_qtyLevels)
+    {
+        for (const auto& levels : sides)
+        {
+            result.qtyLevels += levels.size();
+        }
+    }
+    return result;
+}
+
+order_cache::stats::IndexStats OrderCache::_indexStats(const UserOrdersMap& map)
+{
+    order_cache::stats::IndexStats result;
+    result.table = order_cache::stats::hashTableStats(map);
+
+    std::vector<std::size_t> lengths;
+    lengths.reserve(map.size());
+    map.forEach(
+        [&](std::string_view, const UserOrders& orders)
+        {
+            lengths.emplace_back(orders.count);
+            result.usedEntries += orders.count;
+        });
+    // the lists are linked through the order slots, nothing is reserved ahead
+    result.reservedEntries = result.usedEntries;
+    result.lengths = order_cache::stats::keyLengthStats(std::move(lengths));
+    return result;
+}
+
+order_cache::stats::IndexStats OrderCache::_securityIndexStats() const
+{
+    order_cache::stats::IndexStats result;
+    // the lookup table is the symbol table of the storage, securities stay interned once drained
+    result.table = order_cache::stats::hashTableStats(m_orderStorage.securities().map());
+
+    std::vector<std::size_t> lengths;
+    for (const auto& segment : m_orderStorage.segments())
+    {
+        if (!segment.empty())
+        {
+            lengths.emplace_back(segment.size());
+        }
+        result.usedEntries += segment.size();
+        result.reservedEntries += segment.capacity();
+    }
+    result.lengths = order_cache::stats::keyLengthStats(std::move(lengths));
+    result.reservedUnusedBytes =
+        (result.reservedEntries - result.usedEntries) * sizeof(order_cache::storage::HotOrder);
+    return result;
+}
+
+order_cache::memory::MemoryUsage OrderCache::memoryUsage() const
+{
+    order_cache::memory::MemoryUsage result;
+    result.storage = m_orderStorage.memoryUsage();
+    result.userIndex = _indexMemory(m_userOrders);
+    result.qtyIndex = _qtyIndexMemory();
+    return result;
+}
+
+void OrderCache::reserve(std::size_t expectedOrders, std::size_t expectedSecurities, std::size_t expectedUsers,
+                         std::size_t expectedCompanies)
+{
+    m_orderStorage.reserve(expectedOrders, expectedSecurities, expectedCompanies);
+    m_expectedUsers = std::max(m_expectedUsers, expectedUsers);
+    if (m_userIndexBuilt)
+    {
+        m_userOrders.reserve(expectedUsers);
+    }
+}
+
+void OrderCache::prefault()
+{
+    ScopedTrace trace{"prefault"};
+    m_orderStorage.prefault();
+}
+
+void OrderCache::compact()
+{
+    ScopedTrace trace{"compact"};
+    m_orderStorage.compact();
+    if (m_userIndexUsed)
+    {
+        m_userOrders.shrinkToFit();
+    }
+    else
+    {
+        m_userOrders = UserOrdersMap{};
+        m_userIndexBuilt = false;
+    }
+    m_userIndexUsed = false;
+
+    // drained levels are erased as they empty, only an unused index is left to release
+    if (!m_qtyIndexUsed)
+    {
+        m_qtyLevels.clear();
+        m_qtyLevels.shrink_to_fit();
+        m_qtyLevelNodes.release();
+        m_qtyIndexBuilt = false;
+    }
+    m_qtyIndexUsed = false;
+}
+
+order_cache::memory::IndexMemory OrderCache::_indexMemory(const UserOrdersMap& map)
+{
+    using namespace order_cache::memory;
+
+    IndexMemory result;
+    result.slots = map.slotMemory();
+    result.keyStrings = map.keyMemory();
+    return result;
+}
+
 std::optional<uint64_t> OrderCache::_idToIndex(std::string_view id)
 {
     constexpr auto prefixLen{ORDER_ID_PREFIX.size()};
@@ -198,7 +616,8 @@ std::optional<uint64_t> OrderCache::_idToIndex(std::string_view id)
     auto [_, ec] = std::from_chars(numPart.data(),
                                    numPart.data() + numPart.size(),
                                    value);
-    if (ec != std::errc{})
+    // the last ids of the range are not stored, the largest one is the end marker of the order lists
+    if (ec != std::errc{} || value >= order_cache::storage::INDEX_LIMIT)
     {
         return std::nullopt;
     }
@@ -207,42 +626,176 @@ std::optional<uint64_t> OrderCache::_idToIndex(std::string_view id)
 
 void OrderCache::_cancelOrderByIndex(uint64_t index)
 {
-    const auto& order{m_orderStorage.getOrder(index)};
-    _removeOrderId(m_userOrderIds, order.userSv(), index);
-    _removeOrderId(m_securityOrderIds, order.securityIdSv(), index);
-    m_orderStorage.cancelOrder(index);
+    if (m_userIndexBuilt || m_qtyIndexBuilt)
+    {
+        ScopedTrace indexTrace{"indexRemove"};
+        if (m_userIndexBuilt)
+        {
+            _unlinkUserOrder(index);
+        }
+        if (m_qtyIndexBuilt)
+        {
+            _unlinkQtyOrder(index);
+        }
+    }
+    {
+        ScopedTrace storageTrace{"storageRemove"};
+        m_orderStorage.cancelOrder(index);
+    }
+    ++m_ordersCancelled;
+}
+
+void OrderCache::_buildUserIndex()
+{
+    ScopedTrace trace{"indexBuild"};
+    m_userOrders.reserve(m_expectedUsers);
+    m_orderStorage.forEachOrder([this](uint64_t index) { _linkUserOrder(index); });
+    m_userIndexBuilt = true;
 }
 
-void OrderCache::_addOrderId(OrderIdsMap& map, std::string_view key, uint64_t id)
+void OrderCache::_linkUserOrder(uint64_t index)
 {
-    auto mapIt{map.find(key)};
-    if (mapIt == map.end())
+    // the map copies the key, views into stored orders dangle once the storage grows
+    auto& orders{*m_userOrders.tryEmplace(m_orderStorage.cold(index).user).first};
+    m_orderStorage.userLinks(index) = order_cache::storage::OrderLinks{orders.tail, order_cache::storage::NO_ORDER};
+    if (orders.tail == order_cache::storage::NO_ORDER)
     {
-        std::vector<uint64_t> orderIds{id};
-        orderIds.reserve(ORDER_IDS_VECTOR_CAPACITY);
-        map.emplace_hint(mapIt, key, std::move(orderIds));
+        orders.head = index;
     }
     else
     {
-        mapIt->second.emplace_back(id);
+        m_orderStorage.userLinks(orders.tail).next = index;
     }
+    orders.tail = index;
+    ++orders.count;
 }
 
-void OrderCache::_removeOrderId(OrderIdsMap& map, std::string_view key, uint64_t id)
+void OrderCache::_unlinkUserOrder(uint64_t index)
 {
-    if (auto mapIt{map.find(key)}; mapIt != map.end())
+    using order_cache::storage::NO_ORDER;
+
+    const auto& user{m_orderStorage.cold(index).user};
+    auto* orders{m_userOrders.find(user)};
+    if (orders == nullptr)
     {
-        auto& orderIds{mapIt->second};
-        auto idIt{std::find(orderIds.begin(), orderIds.end(), id)};
-        if (idIt != orderIds.end())
-        {
-            std::swap(*idIt, orderIds.back());
-            orderIds.pop_back();
-        }
+        return;
+    }
+    const auto links{m_orderStorage.userLinks(index)};
+    if (links.prev == NO_ORDER)
+    {
+        orders->head = links.next;
+    }
+    else
+    {
+        m_orderStorage.userLinks(links.prev).next = links.next;
+    }
+    if (links.next == NO_ORDER)
+    {
+        orders->tail = links.prev;
+    }
+    else
+    {
+        m_orderStorage.userLinks(links.next).prev = links.prev;
+    }
+
+    if (--orders->count == 0)
+    {
+        m_userOrders.erase(user);
+    }
+}
+
+void OrderCache::_buildQtyIndex()
+{
+    ScopedTrace trace{"indexBuild"};
+    _resizeQtyLevels(m_orderStorage.securities().size());
+    m_orderStorage.forEachOrder([this](uint64_t index) { _linkQtyOrder(index); });
+    m_qtyIndexBuilt = true;
+}
+
+OrderCache::QtyLevels& OrderCache::_qtyLevels(order_cache::storage::Symbol security,
+                                              order_cache::storage::Side side)
+{
+    if (security >= m_qtyLevels.size())
+    {
+        _resizeQtyLevels(security + 1);
+    }
+    return m_qtyLevels[security][static_cast<std::size_t>(side)];
+}
 
-        if (orderIds.empty())
+void OrderCache::_resizeQtyLevels(std::size_t securities)
+{
+    // the maps keep their resource when the vector moves them, a copy would fall back to the default one
+    static_assert(std::is_nothrow_move_constructible_v<QtyLevels>);
+    while (m_qtyLevels.size() < securities)
+    {
+        m_qtyLevels.push_back({QtyLevels{&m_qtyLevelNodes}, QtyLevels{&m_qtyLevelNodes}});
+    }
+}
+
+void OrderCache::_linkQtyOrder(uint64_t index)
+{
+    using order_cache::storage::NO_ORDER;
+
+    const auto& order{m_orderStorage.hot(index)};
+    auto& levels{_qtyLevels(m_orderStorage.security(index), order.side)};
+    auto& level{levels[order.qty]};
+    m_orderStorage.qtyLinks(index) = order_cache::storage::OrderLinks{level.tail, NO_ORDER};
+    if (level.tail == NO_ORDER)
+    {
+        level.head = index;
+    }
+    else
+    {
+        m_orderStorage.qtyLinks(level.tail).next = index;
+    }
+    level.tail = index;
+    ++level.count;
+}
+
+void OrderCache::_unlinkQtyOrder(uint64_t index)
+{
+    using order_cache::storage::NO_ORDER;
+
+    const auto& order{m_orderStorage.hot(index)};
+    auto& levels{_qtyLevels(m_orderStorage.security(index), order.side)};
+    const auto found{levels.find(order.qty)};
+    auto& level{found->second};
+    const auto links{m_orderStorage.qtyLinks(index)};
+    if (links.prev == NO_ORDER)
+    {
+        level.head = links.next;
+    }
+    else
+    {
+        m_orderStorage.qtyLinks(links.prev).next = links.next;
+    }
+    if (links.next == NO_ORDER)
+    {
+        level.tail = links.prev;
+    }
+    else
+    {
+        m_orderStorage.qtyLinks(links.next).prev = links.prev;
+    }
+
+    if (--level.count == 0)
+    {
+        levels.erase(found);
+    }
+}
+
+std::size_t OrderCache::_qtyIndexMemory() const
+{
+    // a tree node is the color, the parent and child links and the key/value pair; the free nodes the pool
+    // keeps for the next levels are not counted
+    constexpr auto NODE_BYTES{sizeof(int) + 3 * sizeof(void*) + sizeof(QtyLevels::value_type)};
+    auto bytes{order_cache::memory::vectorHeapBytes(m_qtyLevels)};
+    for (const auto& sides : m_qtyLevels)
+    {
+        for (const auto& levels : sides)
         {
-            map.erase(mapIt);
+            bytes += levels.size() * order_cache::memory::heapBlockBytes(NODE_BYTES);
         }
     }
+    return bytes;
 }
@@ -1,13 +1,25 @@
 #pragma once
 
+#include "LatencyHistogram.h"
+#include "FlatHashMap.h"
+#include "MemoryUsage.h"
 #include "Order.h"
+#include "OrderCacheStats.h"
 #include "OrderIndexedStorage.h"
 
+#include <array>
 #include <cstdint>
+#include <limits>
+#include <map>
+#include <memory_resource>
 #include <optional>
-#include <unordered_map>
 
 
+namespace order_cache::bench
+{
+    struct OrderCacheInternals;
+}
+
 // Provide an implementation for the OrderCacheInterface interface class.
 // Your implementation class should hold all relevant data structures you think
 // are needed.
@@ -59,27 +71,198 @@ public:
 
     std::vector<Order> getAllOrders() const override;
 
-private:
-    static constexpr size_t ORDERS_STORAGE_CAPACITY{1'048'576};
-    static constexpr size_t USER_ORDER_IDS_MAP_CAPACITY{2'048};
-    static constexpr size_t SECURITY_ORDER_IDS_MAP_CAPACITY{2'048};
-    static constexpr size_t ORDER_IDS_VECTOR_CAPACITY{1'128};
+    // resting quantity per side and order count of one company in one security
+    struct CompanyVolume
+    {
+        uint64_t buyQty{0};
+        uint64_t sellQty{0};
+        unsigned int orders{0};
+    };
+
+    // read from the company's book in the security, O(1)
+    [[nodiscard]] CompanyVolume getCompanyVolumeForSecurity(const std::string& securityId,
+                                                            const std::string& company) const;
+
+    // the orders of one company in one security in the order they were added, O(orders returned)
+    [[nodiscard]] std::vector<Order> getOrdersForSecIdAndCompany(const std::string& securityId,
+                                                                 const std::string& company) const;
+
+    // cancels the orders of one company in one security, O(orders cancelled)
+    void cancelOrdersForSecIdAndCompany(const std::string& securityId, const std::string& company);
+
+    // cancels every order of every user of a company, security by security, O(orders cancelled)
+    void cancelOrdersForCompany(const std::string& company);
+
+    // the orders of one security a filtered cancel removes, an empty side, user or company matches any
+    struct CancelFilter
+    {
+        std::string securityId;
+        std::string side{}; // Buy, Sell or empty for both
+        unsigned int minQty{0};
+        unsigned int maxQty{std::numeric_limits<unsigned int>::max()};
+        std::string user{};
+        std::string company{};
+    };
+
+    // cancels the orders matching every field of the filter. Walks the shortest of the company's book, the
+    // user's list and the quantity levels in range, so it costs O(orders passing the narrowest field); the
+    // segment is only scanned when that list holds a large share of it. The first call filtering on a side or
+    // qty builds the quantity index, the first one filtering on a user builds the user index. From then on
+    // every add and cancel also pays a tree lookup in the levels of its security side; level nodes are pooled,
+    // so quantities coming and going allocate nothing once the pool has held as many levels. Throws
+    // std::invalid_argument on a side other than Buy or Sell.
+    void cancelOrders(const CancelFilter& filter);
+
+    // per operation latencies, only populated when built with ORDER_CACHE_LATENCY_HISTOGRAMS; without it
+    // the cache holds no histograms and this is an empty snapshot
+    [[nodiscard]] const order_cache::metrics::LatencyHistograms& latencyHistograms() const noexcept
+    {
+        return m_latencyHistograms.histograms();
+    }
+
+    void resetLatencyHistograms() noexcept { m_latencyHistograms.reset(); }
+
+    // operation counters and secondary index health, walks every index key and hash bucket
+    [[nodiscard]] order_cache::stats::OrderCacheStats stats() const;
+
+    // estimated heap bytes held by the storage and the indexes, walks every slot
+    [[nodiscard]] order_cache::memory::MemoryUsage memoryUsage() const;
+
+    // sizes every structure for the expected book so the first adds neither reallocate nor rehash: the
+    // order arrays for a window of `expectedOrders` consecutive ids, the symbol tables and the user index
+    void reserve(std::size_t expectedOrders, std::size_t expectedSecurities, std::size_t expectedUsers,
+                 std::size_t expectedCompanies);
+
+    // touches the reserved order arrays once, so their page faults happen now instead of on the first adds
+    void prefault();
+
+    // releases what cancelled orders left behind: dead slot strings, the dead ends of the id window, spare
+    // segment chunks and the reserved capacity of the indexes. Linear in the id window, the next adds
+    // allocate again; call it after mass cancellations, e.g. once a large user was cancelled. The user
+    // index is dropped when no user was cancelled since the previous compact, the next one rebuilds it; so
+    // is the quantity index when no filtered cancel ran.
+    void compact();
 
+private:
+    // microbenchmarks drive the private helpers directly
+    friend struct order_cache::bench::OrderCacheInternals;
 
     using OrderIdIndex = uint64_t;
     using User = std::string_view;
     using SecurityID = std::string_view;
-    using OrderIdsMap = std::unordered_map<std::string_view, std::vector<OrderIdIndex>>;
+
+    // the ends and length of a user's order list, the links run through the cold order slots
+    struct UserOrders
+    {
+        OrderIdIndex head{order_cache::storage::NO_ORDER};
+        OrderIdIndex tail{order_cache::storage::NO_ORDER};
+        uint64_t count{0};
+    };
+
+    // user keys and their list ends live inline in the slots, lookups by any string_view never allocate
+    using UserOrdersMap = order_cache::storage::FlatHashMap<UserOrders>;
+
+    // the orders of one security side at one quantity in arrival order, the links run through the cold slots
+    struct QtyLevel
+    {
+        OrderIdIndex head{order_cache::storage::NO_ORDER};
+        OrderIdIndex tail{order_cache::storage::NO_ORDER};
+        uint64_t count{0};
+    };
+
+    // keyed by qty, so a range of quantities is a run of levels; a level is erased with its last order, the
+    // index holds the live quantities only. The nodes come from m_qtyLevelNodes, a new quantity reuses the
+    // node of a drained one
+    using QtyLevels = std::pmr::map<unsigned int, QtyLevel>;
+
+    // a linked candidate is a cache miss, it costs about as much as this many sequentially scanned entries
+    static constexpr uint64_t LINKED_VISIT_COST{8};
+
+    // a CancelFilter with its names interned, NO_SYMBOL and an empty user match any
+    struct OrderFilter
+    {
+        order_cache::storage::Symbol security{0};
+        bool anySide{true};
+        order_cache::storage::Side side{order_cache::storage::Side::Buy};
+        unsigned int minQty{0};
+        unsigned int maxQty{std::numeric_limits<unsigned int>::max()};
+        std::string_view user{};
+        order_cache::storage::Symbol company{order_cache::storage::NO_SYMBOL};
+
+        // whether the quantity index can narrow the candidates
+        [[nodiscard]] bool narrowsQtyOrSide() const noexcept
+        {
+            return !anySide || minQty > 0 || maxQty < std::numeric_limits<unsigned int>::max();
+        }
+    };
+
+    struct SecurityVolume
+    {
+        int64_t totalBuy{0};
+        int64_t totalSell{0};
+        uint64_t maxCompanyVolume{0}; // buy + sell of the company with the largest volume
+    };
 
     order_cache::storage::OrderIndexedStorage m_orderStorage;
-    OrderIdsMap m_userOrderIds;
-    OrderIdsMap m_securityOrderIds;
+    // built by the first cancelOrdersForUser, until then adds and cancels skip it; a deployment that cannot
+    // afford that pass on its first user cancel triggers it early by cancelling an unknown user
+    UserOrdersMap m_userOrders;
+    bool m_userIndexBuilt{false};
+    bool m_userIndexUsed{false}; // a user was cancelled since the last compact
+    std::size_t m_expectedUsers{0};
+    // keeps the nodes of drained levels for the next quantities, only released with the whole index
+    std::pmr::unsynchronized_pool_resource m_qtyLevelNodes;
+    // levels per security symbol and side, built by the first cancel filtering on side or qty
+    std::vector<std::array<QtyLevels, 2>> m_qtyLevels;
+    bool m_qtyIndexBuilt{false};
+    bool m_qtyIndexUsed{false}; // a filtered cancel ran since the last compact
+    mutable order_cache::metrics::OperationLatencies<> m_latencyHistograms;
+    mutable std::array<uint64_t, order_cache::metrics::LatencyHistograms::OPERATIONS> m_operationCounts{};
+    uint64_t m_ordersAdded{0};
+    uint64_t m_ordersCancelled{0};
+    uint64_t m_duplicateOrdersIgnored{0};
 
 
     void _cancelOrderByIndex(uint64_t index);
+    // drains one company book, the book stays valid since removals never rehash the book table
+    void _cancelBook(const order_cache::storage::SecuritySegment& segment,
+                     const order_cache::storage::CompanyBook& book);
+
+    void _countOperation(order_cache::metrics::Operation op) const noexcept
+    {
+        ++m_operationCounts[static_cast<std::size_t>(op)];
+    }
+
+    [[nodiscard]] static order_cache::stats::IndexStats _indexStats(const UserOrdersMap& map);
+    [[nodiscard]] order_cache::stats::IndexStats _securityIndexStats() const;
+    [[nodiscard]] static order_cache::memory::IndexMemory _indexMemory(const UserOrdersMap& map);
+
+    [[nodiscard]] static SecurityVolume _aggregateCompanyVolumes(const order_cache::storage::SecuritySegment& segment);
+    // the book of `company` in `securityId`, nullptr when either is unknown or the company never traded it
+    [[nodiscard]] std::pair<const order_cache::storage::SecuritySegment*, const order_cache::storage::CompanyBook*>
+    _companyBook(std::string_view securityId, std::string_view company) const;
+    [[nodiscard]] static unsigned int _matchingSize(const SecurityVolume& volume) noexcept;
+
+    [[nodiscard]] static std::optional<uint64_t> _idToIndex(std::string_view id);
+
+    // one pass over the live orders in id order, so every user list starts out in arrival order
+    void _buildUserIndex();
+
+    // O(1) append to and unlink from the list of the order's user, the order must be in the storage
+    void _linkUserOrder(uint64_t index);
+    void _unlinkUserOrder(uint64_t index);
+
+    // one pass over the live orders in id order, like the user index
+    void _buildQtyIndex();
 
-    [[nodiscard]] static inline std::optional<uint64_t> _idToIndex(std::string_view id);
+    // append to and unlink from the level of the order, O(log levels) of its security side
+    void _linkQtyOrder(uint64_t index);
+    void _unlinkQtyOrder(uint64_t index);
+    [[nodiscard]] QtyLevels& _qtyLevels(order_cache::storage::Symbol security, order_cache::storage::Side side);
+    void _resizeQtyLevels(std::size_t securities);
+    [[nodiscard]] std::size_t _qtyIndexMemory() const;
 
-    static inline void _addOrderId(OrderIdsMap& map, std::string_view key, uint64_t id);
-    static inline void _removeOrderId(OrderIdsMap& map, std::string_view key, uint64_t id);
+    // picks the access path with the fewest candidates and cancels the candidates matching the whole filter
+    void _cancelMatching(const OrderFilter& filter);
+    [[nodiscard]] bool _matches(const order_cache::storage::HotOrder& order, const OrderFilter& filter) const;
 };
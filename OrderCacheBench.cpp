@@ -0,0 +1,583 @@
+#include "Benchmark.h"
+#include "HugePageAllocator.h"
+#include "OrderCache.h"
+#include "OrderGenerator.h"
+#include "Tracing.h"
+#include "WorkloadGenerator.h"
+
+#include <algorithm>
+#include <fstream>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace order_cache::bench;
+using namespace order_cache::workload;
+
+namespace
+{
+    struct BenchConfig
+    {
+        unsigned int numOrders{200'000};
+        GeneratorConfig generator{};
+        LifetimeDistribution lifetime{LifetimeDistribution::Exponential};
+        BenchmarkOptions options{};
+        std::string filter{};
+        bool csv{false};
+        bool stats{false};
+        std::string tracePrefix{};
+        bool reserve{true};
+        bool prefault{false};
+        bool regularPages{!order_cache::alloc::HUGE_PAGES_ENABLED};
+        bool hugePages{order_cache::alloc::HUGE_PAGES_ENABLED};
+    };
+
+    // State shared by all workloads, orders are generated once and replayed by every run
+    struct BenchContext
+    {
+        BenchConfig config;
+        std::vector<Order> orders;
+        std::vector<Order> newUserOrders; // the same orders, each from a user never seen before
+        std::vector<std::string> users;
+        std::vector<std::string> securities;
+        std::vector<std::string> companies;
+        OperationStream lifecycle;
+        std::size_t lifecycleWarmOps{0};
+        std::unique_ptr<OrderCache> cache;
+
+        // sized for the generated flow like a deployment knowing its expected book
+        void resetCache() { resetCache(config.generator.users.count); }
+
+        void resetCache(std::size_t expectedUsers)
+        {
+            cache = std::make_unique<OrderCache>();
+            if (config.reserve)
+            {
+                const auto& gen{config.generator};
+                cache->reserve(config.numOrders, gen.securities.count, expectedUsers, gen.companies.count);
+            }
+            if (config.prefault)
+            {
+                cache->prefault();
+            }
+        }
+
+        void fill(std::size_t count)
+        {
+            resetCache();
+            for (std::size_t i = 0; i < count && i < orders.size(); ++i)
+            {
+                cache->addOrder(orders[i]);
+            }
+        }
+    };
+
+    void generateOrders(BenchContext& ctx)
+    {
+        OrderGenerator generator{ctx.config.generator};
+        ctx.orders = generator.generate(ctx.config.numOrders);
+        ctx.users = generator.users();
+        ctx.securities = generator.securities();
+        ctx.companies = generator.companies();
+        ctx.newUserOrders.reserve(ctx.orders.size());
+        for (std::size_t i = 0; i < ctx.orders.size(); ++i)
+        {
+            const auto& o{ctx.orders[i]};
+            ctx.newUserOrders.emplace_back(o.orderId(), o.securityId(), o.side(), o.qty(),
+                                           "NewUser" + std::to_string(i), o.company());
+        }
+
+        // add/cancel/amend interleaving around a steady state book of about a quarter of the orders
+        LifecycleConfig lifecycle;
+        lifecycle.orders = ctx.config.generator;
+        lifecycle.orders.seed += 1;
+        lifecycle.initialOrders = ctx.config.numOrders / 4;
+        lifecycle.meanLifetime = static_cast<double>(ctx.config.numOrders) / 4;
+        lifecycle.lifetime = ctx.config.lifetime;
+        ctx.lifecycle = LifecycleGenerator{lifecycle}.generate(ctx.config.numOrders);
+        ctx.lifecycleWarmOps = lifecycle.initialOrders;
+    }
+
+    // Replays the lifecycle stream, only operations accepted by `filter` are timed
+    Workload makeLifecycleWorkload(BenchContext& ctx, std::string name, std::function<bool(OperationType)> filter)
+    {
+        return {
+            std::move(name),
+            [&ctx]
+            {
+                ctx.resetCache();
+                const auto& ops{ctx.lifecycle.operations};
+                for (std::size_t i = 0; i < ctx.lifecycleWarmOps; ++i)
+                {
+                    apply(*ctx.cache, ctx.lifecycle, ops[i]);
+                }
+            },
+            [&ctx, filter](LatencyRecorder& r)
+            {
+                const auto& ops{ctx.lifecycle.operations};
+                for (std::size_t i = ctx.lifecycleWarmOps; i < ops.size(); ++i)
+                {
+                    if (filter(ops[i].type))
+                    {
+                        timed(r, [&] { apply(*ctx.cache, ctx.lifecycle, ops[i]); });
+                    }
+                    else
+                    {
+                        apply(*ctx.cache, ctx.lifecycle, ops[i]);
+                    }
+                }
+            }
+        };
+    }
+
+    std::vector<Workload> makeWorkloads(BenchContext& ctx)
+    {
+        std::vector<Workload> workloads;
+        const auto n{ctx.orders.size()};
+
+        workloads.push_back({
+            "add",
+            [&ctx] { ctx.resetCache(); },
+            [&ctx](LatencyRecorder& r)
+            {
+                for (const auto& order : ctx.orders)
+                {
+                    timed(r, [&] { ctx.cache->addOrder(order); });
+                }
+            }
+        });
+
+        // every add creates a user key in a user index that starts empty and grows all along, while the
+        // storage is reserved: the max latency shows what a single growth of the index costs
+        workloads.push_back({
+            "add_new_users",
+            [&ctx] { ctx.resetCache(0); },
+            [&ctx](LatencyRecorder& r)
+            {
+                for (const auto& order : ctx.newUserOrders)
+                {
+                    timed(r, [&] { ctx.cache->addOrder(order); });
+                }
+            }
+        });
+
+        // steady state churn, the book keeps half of the orders alive while the oldest ones are cancelled
+        workloads.push_back({
+            "add_cancel_churn",
+            [&ctx, n] { ctx.fill(n / 2); },
+            [&ctx, n](LatencyRecorder& r)
+            {
+                for (std::size_t i = n / 2; i < n; ++i)
+                {
+                    timed(r, [&] { ctx.cache->addOrder(ctx.orders[i]); });
+                    const auto& oldest{ctx.orders[i - n / 2].orderId()};
+                    timed(r, [&] { ctx.cache->cancelOrder(oldest); });
+                }
+            }
+        });
+
+        workloads.push_back({
+            "cancel_user",
+            [&ctx, n] { ctx.fill(n); },
+            [&ctx](LatencyRecorder& r)
+            {
+                for (const auto& user : ctx.users)
+                {
+                    timed(r, [&] { ctx.cache->cancelOrdersForUser(user); });
+                }
+            }
+        });
+
+        workloads.push_back({
+            "cancel_company",
+            [&ctx, n] { ctx.fill(n); },
+            [&ctx](LatencyRecorder& r)
+            {
+                for (const auto& company : ctx.companies)
+                {
+                    timed(r, [&] { ctx.cache->cancelOrdersForCompany(company); });
+                }
+            }
+        });
+
+        workloads.push_back({
+            "cancel_min_qty",
+            [&ctx, n] { ctx.fill(n); },
+            [&ctx](LatencyRecorder& r)
+            {
+                for (const auto& secId : ctx.securities)
+                {
+                    timed(r, [&] { ctx.cache->cancelOrdersForSecIdWithMinimumQty(secId, 2'500); });
+                }
+            }
+        });
+
+        // a risk control style cancel: one side of every security in a narrow qty band, the first call
+        // builds the quantity index
+        workloads.push_back({
+            "cancel_filtered",
+            [&ctx, n] { ctx.fill(n); },
+            [&ctx](LatencyRecorder& r)
+            {
+                for (const auto& secId : ctx.securities)
+                {
+                    const OrderCache::CancelFilter filter{secId, "Sell", 2'000, 2'400};
+                    timed(r, [&] { ctx.cache->cancelOrders(filter); });
+                }
+            }
+        });
+
+        workloads.push_back({
+            "match",
+            [&ctx, n] { ctx.fill(n); },
+            [&ctx](LatencyRecorder& r)
+            {
+                constexpr int PASSES{5};
+                for (int pass = 0; pass < PASSES; ++pass)
+                {
+                    for (const auto& secId : ctx.securities)
+                    {
+                        timed(r, [&] { ctx.cache->getMatchingSizeForSecurity(secId); });
+                    }
+                }
+            }
+        });
+
+        workloads.push_back({
+            "get_all_orders",
+            [&ctx, n] { ctx.fill(n); },
+            [&ctx](LatencyRecorder& r)
+            {
+                constexpr int PASSES{5};
+                for (int pass = 0; pass < PASSES; ++pass)
+                {
+                    timed(r, [&] { ctx.cache->getAllOrders(); });
+                }
+            }
+        });
+
+        // a trading-day like mix: 60% add, 30% cancel, 9% match, 0.9% min qty cancel, 0.1% user cancel
+        workloads.push_back({
+            "mixed",
+            [&ctx, n] { ctx.fill(n / 4); },
+            [&ctx, n](LatencyRecorder& r)
+            {
+                std::mt19937 gen{42};
+                std::uniform_int_distribution<unsigned int> opDist(0, 999);
+                std::size_t nextAdd{n / 4};
+                std::size_t nextCancel{0};
+                std::size_t nextSecurity{0};
+                std::size_t nextUser{0};
+                while (nextAdd < n)
+                {
+                    const auto op{opDist(gen)};
+                    if (op < 600)
+                    {
+                        timed(r, [&] { ctx.cache->addOrder(ctx.orders[nextAdd]); });
+                        ++nextAdd;
+                    }
+                    else if (op < 900)
+                    {
+                        const auto& orderId{ctx.orders[nextCancel++ % nextAdd].orderId()};
+                        timed(r, [&] { ctx.cache->cancelOrder(orderId); });
+                    }
+                    else if (op < 990)
+                    {
+                        const auto& secId{ctx.securities[nextSecurity++ % ctx.securities.size()]};
+                        timed(r, [&] { ctx.cache->getMatchingSizeForSecurity(secId); });
+                    }
+                    else if (op < 999)
+                    {
+                        const auto& secId{ctx.securities[nextSecurity++ % ctx.securities.size()]};
+                        timed(r, [&] { ctx.cache->cancelOrdersForSecIdWithMinimumQty(secId, 4'000); });
+                    }
+                    else
+                    {
+                        const auto& user{ctx.users[nextUser++ % ctx.users.size()]};
+                        timed(r, [&] { ctx.cache->cancelOrdersForUser(user); });
+                    }
+                }
+            }
+        });
+
+        workloads.push_back(makeLifecycleWorkload(ctx, "lifecycle", [](OperationType) { return true; }));
+        for (const auto type : {
+                 OperationType::Add, OperationType::Cancel, OperationType::Amend, OperationType::CancelUser,
+                 OperationType::CancelMinQty, OperationType::Match
+             })
+        {
+            workloads.push_back(makeLifecycleWorkload(ctx, std::string{"lifecycle/"} + operationName(type),
+                                                      [type](OperationType t) { return t == type; }));
+        }
+
+        return workloads;
+    }
+
+    void printUsage(const char* program)
+    {
+        std::cout << "Usage: " << program << " [options]\n"
+            << "  --orders N        number of generated orders (default 200000)\n"
+            << "  --users N         number of distinct users (default 1000)\n"
+            << "  --companies N     number of distinct companies (default 100)\n"
+            << "  --securities N    number of distinct securities (default 1000)\n"
+            << "  --zipf-users S    Zipf exponent of the user popularity (default 0, uniform)\n"
+            << "  --zipf-companies S  Zipf exponent of the company popularity (default 0, uniform)\n"
+            << "  --zipf-securities S Zipf exponent of the security popularity (default 0, uniform)\n"
+            << "  --buy-ratio R     share of Buy orders in [0, 1] (default 0.5)\n"
+            << "  --power-law-qty S lots follow a power law with exponent S instead of uniform 1..50\n"
+            << "  --skewed          preset: zipf 1.1 securities, 1.2 users, 1.0 companies, fixed user company\n"
+            << "  --seed N          generator seed (default 12345)\n"
+            << "  --pareto-lifetime heavy tailed order lifetimes in the lifecycle workloads\n"
+            << "  --runs N          measured runs per workload (default 5)\n"
+            << "  --warmup N        warmup runs per workload (default 1)\n"
+            << "  --filter NAME     run only workloads whose name contains NAME\n"
+            << "  --quick           small dataset, single run, no warmup\n"
+            << "  --csv             print results as CSV\n"
+            << "  --stats           print OrderCache::stats() of the last run after every workload\n"
+            << "  --trace PREFIX    write the spans of the last run to PREFIX<workload>.json as Chrome trace JSON\n"
+            << "                    (needs a build with ORDER_CACHE_TRACING)\n"
+            << "  --no-reserve      start every run from an empty cache instead of OrderCache::reserve() for the flow\n"
+            << "  --prefault        call OrderCache::prefault() after the reserve, before the run\n"
+            << "  --pages MODE      regular, huge or both: page size of the id-indexed order arrays, both runs\n"
+            << "                    every workload twice (huge needs a build with ORDER_CACHE_HUGE_PAGES)\n";
+    }
+
+    bool parseArgs(int argc, char** argv, BenchConfig& cfg)
+    {
+        for (int i = 1; i < argc; ++i)
+        {
+            const std::string arg{argv[i]};
+            const auto next{[&]() -> const char* { return (i + 1 < argc) ? argv[++i] : nullptr; }};
+            const auto nextUint{
+                [&](unsigned int& out)
+                {
+                    const auto* value{next()};
+                    if (value == nullptr)
+                    {
+                        return false;
+                    }
+                    out = static_cast<unsigned int>(std::stoul(value));
+                    return true;
+                }
+            };
+
+            if (arg == "--orders" && nextUint(cfg.numOrders)) { continue; }
+            const auto nextDouble{
+                [&](double& out)
+                {
+                    const auto* value{next()};
+                    if (value == nullptr)
+                    {
+                        return false;
+                    }
+                    out = std::stod(value);
+                    return true;
+                }
+            };
+
+            auto& gen{cfg.generator};
+            if (arg == "--users" && nextUint(gen.users.count)) { continue; }
+            if (arg == "--companies" && nextUint(gen.companies.count)) { continue; }
+            if (arg == "--securities" && nextUint(gen.securities.count)) { continue; }
+            if (arg == "--zipf-users" && nextDouble(gen.users.zipfExponent)) { continue; }
+            if (arg == "--zipf-companies" && nextDouble(gen.companies.zipfExponent)) { continue; }
+            if (arg == "--zipf-securities" && nextDouble(gen.securities.zipfExponent)) { continue; }
+            if (arg == "--buy-ratio" && nextDouble(gen.buyRatio)) { continue; }
+            if (arg == "--power-law-qty" && nextDouble(gen.qtyExponent))
+            {
+                gen.qtyDistribution = QtyDistribution::PowerLawLots;
+                continue;
+            }
+            if (arg == "--seed")
+            {
+                if (const auto* value{next()})
+                {
+                    gen.seed = std::stoull(value);
+                    continue;
+                }
+            }
+            if (arg == "--pareto-lifetime")
+            {
+                cfg.lifetime = LifetimeDistribution::Pareto;
+                continue;
+            }
+            if (arg == "--skewed")
+            {
+                gen.securities.zipfExponent = 1.1;
+                gen.users.zipfExponent = 1.2;
+                gen.companies.zipfExponent = 1.0;
+                gen.userBelongsToOneCompany = true;
+                continue;
+            }
+            if (arg == "--runs" && nextUint(cfg.options.measuredRuns)) { continue; }
+            if (arg == "--warmup" && nextUint(cfg.options.warmupRuns)) { continue; }
+            if (arg == "--filter")
+            {
+                if (const auto* value{next()})
+                {
+                    cfg.filter = value;
+                    continue;
+                }
+            }
+            if (arg == "--quick")
+            {
+                cfg.numOrders = 20'000;
+                cfg.options = BenchmarkOptions{0, 1};
+                continue;
+            }
+            if (arg == "--csv")
+            {
+                cfg.csv = true;
+                continue;
+            }
+            if (arg == "--trace")
+            {
+                if (const auto* value{next()})
+                {
+                    cfg.tracePrefix = value;
+                    continue;
+                }
+            }
+            if (arg == "--stats")
+            {
+                cfg.stats = true;
+                continue;
+            }
+            if (arg == "--no-reserve")
+            {
+                cfg.reserve = false;
+                continue;
+            }
+            if (arg == "--prefault")
+            {
+                cfg.prefault = true;
+                continue;
+            }
+            if (arg == "--pages")
+            {
+                if (const auto* value{next()})
+                {
+                    const std::string mode{value};
+                    cfg.regularPages = mode == "regular" || mode == "both";
+                    cfg.hugePages = mode == "huge" || mode == "both";
+                    continue;
+                }
+            }
+            return false;
+        }
+        const auto& gen{cfg.generator};
+        return cfg.numOrders > 0 && gen.users.count > 0 && gen.companies.count > 0 && gen.securities.count > 0 &&
+            gen.buyRatio >= 0.0 && gen.buyRatio <= 1.0 && cfg.options.measuredRuns > 0 &&
+            (cfg.regularPages || cfg.hugePages);
+    }
+}
+
+int main(int argc, char** argv)
+{
+    BenchContext ctx;
+    if (!parseArgs(argc, argv, ctx.config))
+    {
+        printUsage(argv[0]);
+        return 1;
+    }
+
+    generateOrders(ctx);
+    const auto& cfg{ctx.config};
+    if (!cfg.csv)
+    {
+        const auto& gen{cfg.generator};
+        std::cout << "[     INFO ] orders=" << cfg.numOrders
+            << " users=" << gen.users.count << "(zipf " << gen.users.zipfExponent << ")"
+            << " companies=" << gen.companies.count << "(zipf " << gen.companies.zipfExponent << ")"
+            << " securities=" << gen.securities.count << "(zipf " << gen.securities.zipfExponent << ")"
+            << " buy-ratio=" << gen.buyRatio << " seed=" << gen.seed << '\n'
+            << "[     INFO ]"
+            << " warmup=" << cfg.options.warmupRuns << " runs=" << cfg.options.measuredRuns << '\n'
+            << "[     INFO ] timer overhead ~" << timerOverheadNs() << "ns per sample (included in latencies)\n";
+    }
+
+    using order_cache::trace::TraceRegistry;
+    if (!cfg.tracePrefix.empty() && !order_cache::trace::TRACING_ENABLED)
+    {
+        std::cerr << "[  WARNING ] --trace ignored, rebuild with -DORDER_CACHE_TRACING=ON\n";
+    }
+
+    using order_cache::alloc::hugePageCounters;
+    if (cfg.hugePages && !order_cache::alloc::HUGE_PAGES_ENABLED)
+    {
+        std::cerr << "[  WARNING ] --pages huge runs on regular pages, rebuild with -DORDER_CACHE_HUGE_PAGES=ON\n";
+    }
+    std::vector<bool> pageModes;
+    if (cfg.regularPages)
+    {
+        pageModes.emplace_back(false);
+    }
+    if (cfg.hugePages)
+    {
+        pageModes.emplace_back(true);
+    }
+
+    printHeader(std::cout, cfg.csv);
+    for (auto& workload : makeWorkloads(ctx))
+    {
+        if (!cfg.filter.empty() && workload.name.find(cfg.filter) == std::string::npos)
+        {
+            continue;
+        }
+        if constexpr (order_cache::trace::TRACING_ENABLED)
+        {
+            // keep only the spans of the measured calls, not the ones of filling the cache
+            workload.setup = [setup = std::move(workload.setup)]
+            {
+                setup();
+                TraceRegistry::instance().clear();
+            };
+        }
+        const auto baseName{workload.name};
+        for (const auto huge : pageModes)
+        {
+            // the storage picks its page size when the cache is created in the setup
+            order_cache::alloc::hugePagesRequested() = huge;
+            if (pageModes.size() > 1)
+            {
+                workload.name = baseName + (huge ? "/huge" : "/4k");
+            }
+            printResult(std::cout, runWorkload(workload, cfg.options), cfg.csv);
+            if (huge && !cfg.csv && order_cache::alloc::HUGE_PAGES_ENABLED)
+            {
+                const auto& counters{hugePageCounters()};
+                std::cout << "  large array mappings so far: hugetlbfs " << counters.explicitMappings
+                    << ", transparent " << counters.transparentMappings << ", refused "
+                    << counters.regularMappings << '\n';
+            }
+            if (order_cache::trace::TRACING_ENABLED && !cfg.tracePrefix.empty())
+            {
+                auto fileName{cfg.tracePrefix + workload.name + ".json"};
+                std::replace(fileName.begin() + static_cast<std::ptrdiff_t>(cfg.tracePrefix.size()),
+                             fileName.end(), '/', '_');
+                std::ofstream file{fileName};
+                TraceRegistry::instance().writeChromeTrace(file);
+                if (!cfg.csv)
+                {
+                    std::cout << "  " << TraceRegistry::instance().recorded()
+                        << " spans of the last run written to " << fileName << '\n';
+                }
+            }
+            if constexpr (order_cache::metrics::LATENCY_HISTOGRAMS_ENABLED)
+            {
+                if (!cfg.csv && ctx.cache)
+                {
+                    std::cout << "  in-cache histograms of the last run:\n";
+                    order_cache::metrics::printLatencyHistograms(std::cout, ctx.cache->latencyHistograms());
+                }
+            }
+            if (cfg.stats && !cfg.csv && ctx.cache)
+            {
+                order_cache::stats::printStats(std::cout, ctx.cache->stats());
+            }
+            ctx.cache.reset();
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+#include "OrderCache.h"
+#include "OrderValidator.h"
+
+#include <optional>
+#include <string_view>
+
+namespace order_cache::bench
+{
+    // Befriended by OrderCache, exposes the private hot helpers to the microbenchmarks
+    struct OrderCacheInternals
+    {
+        using OrderIdIndex = OrderCache::OrderIdIndex;
+
+        [[nodiscard]] static std::optional<uint64_t> idToIndex(std::string_view id)
+        {
+            return OrderCache::_idToIndex(id);
+        }
+
+        static void buildUserIndex(OrderCache& cache)
+        {
+            cache._buildUserIndex();
+        }
+
+        // the order must be in the cache, unlinked from its user list before it is linked again
+        static void linkUserOrder(OrderCache& cache, uint64_t index)
+        {
+            cache._linkUserOrder(index);
+        }
+
+        static void unlinkUserOrder(OrderCache& cache, uint64_t index)
+        {
+            cache._unlinkUserOrder(index);
+        }
+
+        // walks the user list the way cancelOrdersForUser does, without cancelling
+        template <typename F>
+        static void forEachUserOrder(OrderCache& cache, std::string_view user, F&& f)
+        {
+            const auto* orders{cache.m_userOrders.find(user)};
+            for (auto index{orders == nullptr ? storage::NO_ORDER : orders->head}; index != storage::NO_ORDER;
+                 index = cache.m_orderStorage.userLinks(index).next)
+            {
+                f(index);
+            }
+        }
+
+        [[nodiscard]] static const storage::ColdOrder& coldOrder(const OrderCache& cache, uint64_t index)
+        {
+            return cache.m_orderStorage.cold(index);
+        }
+
+        [[nodiscard]] static const storage::SecuritySegment* securitySegment(const OrderCache& cache,
+                                                                              std::string_view securityId)
+        {
+            return cache.m_orderStorage.segment(securityId);
+        }
+
+        // per-company aggregation of one security followed by the matching formula
+        [[nodiscard]] static unsigned int matchingSize(OrderCache& cache, const storage::SecuritySegment& segment)
+        {
+            return OrderCache::_matchingSize(cache._aggregateCompanyVolumes(segment));
+        }
+    };
+}
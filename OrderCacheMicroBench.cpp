@@ -0,0 +1,560 @@
+#include "Benchmark.h"
+#include "OrderCacheInternals.h"
+#include "OrderGenerator.h"
+
+#include <algorithm>
+#include <iomanip>
+#include <iostream>
+#include <numeric>
+#include <string>
+#include <vector>
+
+using namespace order_cache::bench;
+using namespace order_cache::workload;
+using order_cache::storage::OrderIndexedStorage;
+using order_cache::validator::OrderValidator;
+
+namespace
+{
+    struct MicroConfig
+    {
+        unsigned int repetitions{7};
+        std::size_t coldWorkingSet{1'000'000}; // entries touched by the cache-cold variants
+        std::string filter{};
+        bool csv{false};
+    };
+
+    struct MicroResult
+    {
+        std::string name;
+        std::string variant;
+        std::size_t calls{0};
+        double cyclesPerCall{0};
+        double nsPerCall{0};
+        double missesPerCall{-1}; // last level cache misses of the best batch, negative without a PMU
+    };
+
+    [[nodiscard]] const CacheMissCounter& cacheMisses()
+    {
+        static const CacheMissCounter counter;
+        return counter;
+    }
+
+    // Sweeps a buffer larger than the last level cache so the next batch starts cold
+    void evictCaches()
+    {
+        static std::vector<uint64_t> buffer(64 * 1024 * 1024 / sizeof(uint64_t), 1);
+        uint64_t sum{0};
+        for (std::size_t i = 0; i < buffer.size(); i += 8)
+        {
+            sum += buffer[i]++;
+        }
+        doNotOptimize(sum);
+    }
+
+    [[nodiscard]] std::vector<std::size_t> shuffledIndexes(std::size_t n, uint64_t seed)
+    {
+        std::vector<std::size_t> indexes(n);
+        std::iota(indexes.begin(), indexes.end(), 0);
+        Random gen{seed};
+        for (std::size_t i = n; i > 1; --i)
+        {
+            std::swap(indexes[i - 1], indexes[gen() % i]);
+        }
+        return indexes;
+    }
+
+    // Best of `repetitions` batches, `prepare` runs untimed before each batch, `batch` performs `calls` calls
+    template <typename Prepare, typename Batch>
+    [[nodiscard]] MicroResult measure(const MicroConfig& cfg, std::string name, std::string variant,
+                                      std::size_t calls, Prepare&& prepare, Batch&& batch)
+    {
+        MicroResult result{std::move(name), std::move(variant), calls};
+        for (unsigned int rep = 0; rep < cfg.repetitions; ++rep)
+        {
+            prepare();
+            const auto startMisses{cacheMisses().read()};
+            const auto startNs{Clock::now()};
+            const auto startCycles{cycleCount()};
+            batch();
+            const auto cycles{static_cast<double>(cycleCount() - startCycles) / static_cast<double>(calls)};
+            const auto ns{static_cast<double>(elapsedNs(startNs, Clock::now())) / static_cast<double>(calls)};
+            const auto misses{static_cast<double>(cacheMisses().read() - startMisses) / static_cast<double>(calls)};
+            if (rep == 0 || cycles < result.cyclesPerCall)
+            {
+                result.cyclesPerCall = cycles;
+                result.nsPerCall = ns;
+                result.missesPerCall = cacheMisses().available() ? misses : -1;
+            }
+        }
+        return result;
+    }
+
+    void print(const MicroConfig& cfg, const MicroResult& r)
+    {
+        if (cfg.csv)
+        {
+            std::cout << r.name << ',' << r.variant << ',' << r.calls << ',' << r.cyclesPerCall << ','
+                << r.nsPerCall << ',';
+            if (r.missesPerCall >= 0)
+            {
+                std::cout << r.missesPerCall;
+            }
+            std::cout << '\n';
+            return;
+        }
+        std::cout << std::left << std::setw(44) << r.name << std::setw(8) << r.variant
+            << std::right << std::setw(10) << r.calls
+            << std::fixed << std::setprecision(1)
+            << std::setw(14) << r.cyclesPerCall << std::setw(12) << r.nsPerCall;
+        if (r.missesPerCall >= 0)
+        {
+            std::cout << std::setw(14) << r.missesPerCall;
+        }
+        else
+        {
+            std::cout << std::setw(14) << "n/a";
+        }
+        std::cout << '\n';
+    }
+
+    [[nodiscard]] bool selected(const MicroConfig& cfg, const std::string& name)
+    {
+        return cfg.filter.empty() || name.find(cfg.filter) != std::string::npos;
+    }
+
+    void benchIdToIndex(const MicroConfig& cfg)
+    {
+        const std::string name{"OrderCache::_idToIndex"};
+        if (!selected(cfg, name))
+        {
+            return;
+        }
+
+        std::vector<std::string> ids;
+        ids.reserve(cfg.coldWorkingSet);
+        for (std::size_t i = 0; i < cfg.coldWorkingSet; ++i)
+        {
+            ids.emplace_back(std::string{ORDER_ID_PREFIX} + std::to_string(i * 7919 % 100'000'000));
+        }
+        const auto order{shuffledIndexes(ids.size(), 1)};
+
+        constexpr std::size_t HOT_IDS{64};
+        const auto calls{ids.size()};
+        print(cfg, measure(cfg, name, "hot", calls, [] {}, [&]
+        {
+            for (std::size_t i = 0; i < calls; ++i)
+            {
+                doNotOptimize(OrderCacheInternals::idToIndex(ids[i % HOT_IDS]));
+            }
+        }));
+        print(cfg, measure(cfg, name, "cold", calls, evictCaches, [&]
+        {
+            for (const auto i : order)
+            {
+                doNotOptimize(OrderCacheInternals::idToIndex(ids[i]));
+            }
+        }));
+    }
+
+    void benchValidateOrder(const MicroConfig& cfg)
+    {
+        const std::string name{"OrderValidator::validateOrder"};
+        if (!selected(cfg, name))
+        {
+            return;
+        }
+
+        OrderGenerator generator{GeneratorConfig{}};
+        const auto orders{generator.generate(cfg.coldWorkingSet / 2)};
+        const auto order{shuffledIndexes(orders.size(), 2)};
+
+        constexpr std::size_t HOT_ORDERS{64};
+        const auto calls{orders.size()};
+        print(cfg, measure(cfg, name, "hot", calls, [] {}, [&]
+        {
+            for (std::size_t i = 0; i < calls; ++i)
+            {
+                doNotOptimize(OrderValidator::validateOrder(orders[i % HOT_ORDERS]));
+            }
+        }));
+        print(cfg, measure(cfg, name, "cold", calls, evictCaches, [&]
+        {
+            for (const auto i : order)
+            {
+                doNotOptimize(OrderValidator::validateOrder(orders[i]));
+            }
+        }));
+    }
+
+    // Unlinks random orders of users holding `length` orders each from their user lists and links them back
+    // (append), then walks whole user lists against a per-user id vector visiting the same orders
+    void benchUserLists(const MicroConfig& cfg, std::size_t length)
+    {
+        const auto suffix{"(len " + std::to_string(length) + ")"};
+        const auto linkName{"OrderCache::_linkUserOrder" + suffix};
+        const auto unlinkName{"OrderCache::_unlinkUserOrder" + suffix};
+        const auto listWalkName{"user walk, intrusive list" + suffix};
+        const auto vectorWalkName{"user walk, id vector" + suffix};
+        if (!selected(cfg, linkName) && !selected(cfg, unlinkName) && !selected(cfg, listWalkName)
+            && !selected(cfg, vectorWalkName))
+        {
+            return;
+        }
+
+        for (const auto* variant : {"hot", "cold"})
+        {
+            const bool cold{std::string{variant} == "cold"};
+            // cap the user count of the short lists, the user map alone would outgrow the cold working set
+            constexpr std::size_t MAX_KEYS{16'384};
+            const auto keyCount{cold ? std::clamp<std::size_t>(cfg.coldWorkingSet / length, 1, MAX_KEYS) : 1};
+
+            std::vector<std::string> keys;
+            for (std::size_t k = 0; k < keyCount; ++k)
+            {
+                keys.emplace_back("User" + std::to_string(k));
+            }
+            // users interleave through the id space the way they do in an order stream
+            OrderCache cache;
+            for (std::size_t i = 0; i < length; ++i)
+            {
+                for (std::size_t k = 0; k < keyCount; ++k)
+                {
+                    cache.addOrder(Order{std::string{ORDER_ID_PREFIX} + std::to_string(i * keyCount + k), "SecId0",
+                        "Buy", 100, keys[k], "Company0"});
+                }
+            }
+            OrderCacheInternals::buildUserIndex(cache);
+
+            // one order per call, random users and random positions inside the user lists
+            constexpr std::size_t CALLS{4096};
+            Random gen{3};
+            std::vector<uint64_t> targets;
+            targets.reserve(CALLS);
+            for (std::size_t i = 0; i < CALLS; ++i)
+            {
+                targets.emplace_back(gen() % length * keyCount + gen() % keyCount);
+            }
+            std::sort(targets.begin(), targets.end());
+            targets.erase(std::unique(targets.begin(), targets.end()), targets.end());
+            const auto order{shuffledIndexes(targets.size(), 4)};
+
+            bool unlinked{false};
+            const auto unlinkAll{
+                [&]
+                {
+                    for (const auto i : order)
+                    {
+                        OrderCacheInternals::unlinkUserOrder(cache, targets[i]);
+                    }
+                    unlinked = true;
+                }
+            };
+            const auto linkAll{
+                [&]
+                {
+                    for (const auto i : order)
+                    {
+                        OrderCacheInternals::linkUserOrder(cache, targets[i]);
+                    }
+                    unlinked = false;
+                }
+            };
+
+            if (selected(cfg, unlinkName))
+            {
+                print(cfg, measure(cfg, unlinkName, variant, targets.size(), [&]
+                {
+                    if (unlinked)
+                    {
+                        linkAll();
+                    }
+                    if (cold)
+                    {
+                        evictCaches();
+                    }
+                }, unlinkAll));
+            }
+            if (selected(cfg, linkName))
+            {
+                print(cfg, measure(cfg, linkName, variant, targets.size(), [&]
+                {
+                    if (!unlinked)
+                    {
+                        unlinkAll();
+                    }
+                    if (cold)
+                    {
+                        evictCaches();
+                    }
+                }, linkAll));
+            }
+            if (unlinked)
+            {
+                linkAll();
+            }
+
+            // both walks read the cold slot of every order, as cancelOrdersForUser does; the list has to,
+            // its links live there, the vector can prefetch ahead since its ids are contiguous
+            std::vector<std::vector<uint64_t>> idVectors(keyCount);
+            for (std::size_t k = 0; k < keyCount; ++k)
+            {
+                OrderCacheInternals::forEachUserOrder(cache, keys[k], [&](uint64_t index)
+                {
+                    idVectors[k].push_back(index);
+                });
+            }
+            const auto walks{std::max<std::size_t>(CALLS / length, 1)};
+            const auto walkOrder{shuffledIndexes(keyCount, 5)};
+            const auto calls{walks * length};
+            const auto prepareWalk{cold ? &evictCaches : +[] {}};
+            if (selected(cfg, listWalkName))
+            {
+                print(cfg, measure(cfg, listWalkName, variant, calls, prepareWalk, [&]
+                {
+                    for (std::size_t w = 0; w < walks; ++w)
+                    {
+                        std::size_t bytes{0};
+                        OrderCacheInternals::forEachUserOrder(cache, keys[walkOrder[w % keyCount]], [&](uint64_t index)
+                        {
+                            bytes += OrderCacheInternals::coldOrder(cache, index).orderId.size();
+                        });
+                        doNotOptimize(bytes);
+                    }
+                }));
+            }
+            if (selected(cfg, vectorWalkName))
+            {
+                print(cfg, measure(cfg, vectorWalkName, variant, calls, prepareWalk, [&]
+                {
+                    for (std::size_t w = 0; w < walks; ++w)
+                    {
+                        std::size_t bytes{0};
+                        for (const auto index : idVectors[walkOrder[w % keyCount]])
+                        {
+                            bytes += OrderCacheInternals::coldOrder(cache, index).orderId.size();
+                        }
+                        doNotOptimize(bytes);
+                    }
+                }));
+            }
+        }
+    }
+
+    void benchStorage(const MicroConfig& cfg)
+    {
+        const std::string addName{"OrderIndexedStorage::addOrder"};
+        const std::string cancelName{"OrderIndexedStorage::cancelOrder"};
+        if (!selected(cfg, addName) && !selected(cfg, cancelName))
+        {
+            return;
+        }
+
+        OrderGenerator generator{GeneratorConfig{}};
+        constexpr std::size_t CALLS{16384};
+        const auto templates{generator.generate(CALLS)};
+
+        for (const auto* variant : {"hot", "cold"})
+        {
+            const bool cold{std::string{variant} == "cold"};
+            const auto slots{cold ? cfg.coldWorkingSet : CALLS};
+            OrderIndexedStorage storage;
+            storage.reserve(slots, GeneratorConfig{}.securities.count, GeneratorConfig{}.companies.count);
+            storage.prefault();
+
+            // distinct random slots spread over the whole storage for the cold variant
+            const auto shuffled{shuffledIndexes(slots, 5)};
+            std::vector<uint64_t> indexes(shuffled.begin(), shuffled.begin() + CALLS);
+            std::vector<Order> pool;
+
+            const auto refill{
+                [&]
+                {
+                    pool = templates;
+                    if (cold)
+                    {
+                        evictCaches();
+                    }
+                }
+            };
+            const auto addAll{
+                [&]
+                {
+                    for (std::size_t i = 0; i < CALLS; ++i)
+                    {
+                        storage.addOrder(std::move(pool[i]), indexes[i]);
+                    }
+                }
+            };
+            const auto cancelAll{
+                [&]
+                {
+                    for (std::size_t i = 0; i < CALLS; ++i)
+                    {
+                        storage.cancelOrder(indexes[i]);
+                    }
+                }
+            };
+
+            if (selected(cfg, addName))
+            {
+                print(cfg, measure(cfg, addName, variant, CALLS, [&]
+                {
+                    if (storage.size() != 0)
+                    {
+                        cancelAll();
+                    }
+                    refill();
+                }, addAll));
+            }
+            if (selected(cfg, cancelName))
+            {
+                print(cfg, measure(cfg, cancelName, variant, CALLS, [&]
+                {
+                    if (storage.size() == 0)
+                    {
+                        refill();
+                        addAll();
+                    }
+                    if (cold)
+                    {
+                        evictCaches();
+                    }
+                }, [&]
+                {
+                    cancelAll();
+                }));
+            }
+        }
+    }
+
+    void benchCompanyAggregation(const MicroConfig& cfg)
+    {
+        const std::string name{"OrderCache::_aggregateCompanyVolumes"};
+        if (!selected(cfg, name))
+        {
+            return;
+        }
+
+        // ~100 live orders per security spread over 100 companies
+        GeneratorConfig config;
+        config.securities.count = static_cast<unsigned int>(std::max<std::size_t>(cfg.coldWorkingSet / 100, 1));
+        OrderGenerator generator{config};
+        OrderCache cache;
+        for (const auto& order : generator.generate(cfg.coldWorkingSet))
+        {
+            cache.addOrder(order);
+        }
+
+        std::vector<const order_cache::storage::SecuritySegment*> lists;
+        std::size_t orders{0};
+        for (const auto& secId : generator.securities())
+        {
+            const auto* segment{OrderCacheInternals::securitySegment(cache, secId)};
+            if (segment != nullptr && !segment->empty())
+            {
+                lists.emplace_back(segment);
+                orders += segment->size();
+            }
+        }
+        const auto order{shuffledIndexes(lists.size(), 6)};
+        const auto calls{lists.size()};
+
+        if (!cfg.csv)
+        {
+            std::cout << "  (" << static_cast<double>(orders) / static_cast<double>(calls)
+                << " orders per security on average)\n";
+        }
+        print(cfg, measure(cfg, name, "hot", calls, [] {}, [&]
+        {
+            for (std::size_t i = 0; i < calls; ++i)
+            {
+                doNotOptimize(OrderCacheInternals::matchingSize(cache, *lists[0]));
+            }
+        }));
+        print(cfg, measure(cfg, name, "cold", calls, evictCaches, [&]
+        {
+            for (const auto i : order)
+            {
+                doNotOptimize(OrderCacheInternals::matchingSize(cache, *lists[i]));
+            }
+        }));
+    }
+
+    bool parseArgs(int argc, char** argv, MicroConfig& cfg)
+    {
+        for (int i = 1; i < argc; ++i)
+        {
+            const std::string arg{argv[i]};
+            const auto* value{(i + 1 < argc) ? argv[i + 1] : nullptr};
+            if (arg == "--reps" && value != nullptr)
+            {
+                cfg.repetitions = static_cast<unsigned int>(std::stoul(value));
+                ++i;
+            }
+            else if (arg == "--working-set" && value != nullptr)
+            {
+                cfg.coldWorkingSet = std::stoull(value);
+                ++i;
+            }
+            else if (arg == "--filter" && value != nullptr)
+            {
+                cfg.filter = value;
+                ++i;
+            }
+            else if (arg == "--quick")
+            {
+                cfg.repetitions = 2;
+                cfg.coldWorkingSet = 100'000;
+            }
+            else if (arg == "--csv")
+            {
+                cfg.csv = true;
+            }
+            else
+            {
+                return false;
+            }
+        }
+        return cfg.repetitions > 0 && cfg.coldWorkingSet > 0;
+    }
+}
+
+int main(int argc, char** argv)
+{
+    MicroConfig cfg;
+    if (!parseArgs(argc, argv, cfg))
+    {
+        std::cout << "Usage: " << argv[0] << " [options]\n"
+            << "  --reps N          repetitions per measurement, the best one is reported (default 7)\n"
+            << "  --working-set N   entries touched by the cache-cold variants (default 1000000)\n"
+            << "  --filter NAME     run only helpers whose name contains NAME\n"
+            << "  --quick           2 repetitions on a 100K working set\n"
+            << "  --csv             print results as CSV\n";
+        return 1;
+    }
+
+    if (cfg.csv)
+    {
+        std::cout << "helper,variant,calls," << CYCLE_UNIT << "_per_call,ns_per_call,llc_misses_per_call\n";
+    }
+    else
+    {
+        std::cout << "[     INFO ] best of " << cfg.repetitions << " repetitions, cold working set "
+            << cfg.coldWorkingSet << " entries, cycles are " << CYCLE_UNIT << " ticks"
+            << (cacheMisses().available() ? "" : ", no cache miss counter (perf_event_open unavailable)") << '\n'
+            << std::left << std::setw(44) << "helper" << std::setw(8) << "variant"
+            << std::right << std::setw(10) << "calls" << std::setw(14) << "cycles/call" << std::setw(12)
+            << "ns/call" << std::setw(14) << "LLC miss/call" << '\n';
+    }
+
+    benchIdToIndex(cfg);
+    benchValidateOrder(cfg);
+    for (const std::size_t length : {1, 16, 256, 4096})
+    {
+        benchUserLists(cfg, length);
+    }
+    benchStorage(cfg);
+    benchCompanyAggregation(cfg);
+    return 0;
+}
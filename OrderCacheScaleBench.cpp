@@ -0,0 +1,386 @@
+#include "Benchmark.h"
+#include "OrderCache.h"
+#include "OrderGenerator.h"
+#include "ProcessMemory.h"
+
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <set>
+#include <string>
+#include <tuple>
+#include <vector>
+
+using namespace order_cache::bench;
+using namespace order_cache::workload;
+
+namespace
+{
+    struct ScaleConfig
+    {
+        std::vector<uint64_t> orders{1'000'000, 10'000'000, 100'000'000};
+        std::vector<uint64_t> securities{10, 1'000, 100'000, 1'000'000};
+        std::vector<uint64_t> companies{10, 1'000, 100'000};
+        bool dense{true};
+        bool sparse{true};
+        uint64_t sparseStride{64};
+        unsigned int users{1'000};
+        std::size_t matchQueries{1'000};
+        std::size_t memoryBudget{0}; // bytes of RSS a cell may grow, 0 picks half of the available memory
+        bool memoryBreakdown{false};
+        bool csv{false};
+    };
+
+    struct Cell
+    {
+        uint64_t orders{0};
+        uint64_t securities{0};
+        uint64_t companies{0};
+        bool sparse{false};
+    };
+
+    enum class CellStatus : uint32_t
+    {
+        Completed = 0,
+        OverBudget, // stopped once the RSS grew past the budget, the timings cover the orders added so far
+        Skipped, // a smaller order count of the same shape already went over budget
+    };
+
+    struct CellResult
+    {
+        Cell cell{};
+        CellStatus status{CellStatus::Completed};
+        uint64_t ordersAdded{0};
+        double addNsPerOrder{0};
+        double matchNsPerQuery{0};
+        double cancelNsPerOrder{0};
+        double seconds{0};
+        std::size_t baselineRssBytes{0};
+        std::size_t rssAfterAddBytes{0};
+        std::size_t peakRssBytes{0};
+        order_cache::memory::MemoryUsage memory{}; // OrderCache::memoryUsage() once every order is added
+    };
+
+    [[nodiscard]] const char* statusName(CellStatus status) noexcept
+    {
+        switch (status)
+        {
+        case CellStatus::Completed: return "ok";
+        case CellStatus::OverBudget: return "budget";
+        case CellStatus::Skipped: return "skipped";
+        default: return "unknown";
+        }
+    }
+
+    [[nodiscard]] double perCall(uint64_t ns, uint64_t calls) noexcept
+    {
+        return calls == 0 ? 0.0 : static_cast<double>(ns) / static_cast<double>(calls);
+    }
+
+    // Adds the orders straight from the generator (nothing but the cache holds them), queries a spread
+    // of securities and cancels every order by id. Peak RSS is measured from a reset high water mark.
+    [[nodiscard]] CellResult runCell(const ScaleConfig& cfg, const Cell& cell, std::size_t budget)
+    {
+        CellResult result{cell};
+
+        GeneratorConfig generatorConfig;
+        generatorConfig.users.count = cfg.users;
+        generatorConfig.securities.count = static_cast<unsigned int>(cell.securities);
+        generatorConfig.companies.count = static_cast<unsigned int>(cell.companies);
+        generatorConfig.orderIdStride = cell.sparse ? cfg.sparseStride : 1;
+        OrderGenerator generator{generatorConfig};
+
+        releaseFreeMemory();
+        resetPeakRss();
+        result.baselineRssBytes = processMemory().rssBytes;
+        const auto cellStart{Clock::now()};
+
+        auto cache{std::make_unique<OrderCache>()};
+        cache->reserve(cell.orders, cell.securities, cfg.users, cell.companies);
+
+        constexpr uint64_t RSS_CHECK_INTERVAL{4'096};
+        auto start{Clock::now()};
+        for (uint64_t i = 0; i < cell.orders; ++i)
+        {
+            cache->addOrder(generator.next());
+            ++result.ordersAdded;
+            if (result.ordersAdded % RSS_CHECK_INTERVAL == 0 &&
+                processMemory().rssBytes > result.baselineRssBytes + budget)
+            {
+                result.status = CellStatus::OverBudget;
+                break;
+            }
+        }
+        result.addNsPerOrder = perCall(elapsedNs(start, Clock::now()), result.ordersAdded);
+        result.rssAfterAddBytes = processMemory().rssBytes;
+        result.memory = cache->memoryUsage();
+
+        const auto& securities{generator.securities()};
+        const auto queries{std::min<std::size_t>(cfg.matchQueries, securities.size())};
+        const auto step{securities.size() / std::max<std::size_t>(queries, 1)};
+        unsigned int matched{0};
+        start = Clock::now();
+        for (std::size_t q = 0; q < queries; ++q)
+        {
+            matched += cache->getMatchingSizeForSecurity(securities[q * step]);
+        }
+        result.matchNsPerQuery = perCall(elapsedNs(start, Clock::now()), queries);
+        doNotOptimize(matched);
+
+        // order ids are rebuilt in a reused buffer, the timing includes formatting the id
+        std::string orderId;
+        const auto stride{generatorConfig.orderIdStride};
+        start = Clock::now();
+        for (uint64_t i = 0; i < result.ordersAdded; ++i)
+        {
+            orderId.assign(ORDER_ID_PREFIX);
+            orderId += std::to_string(i * stride);
+            cache->cancelOrder(orderId);
+        }
+        result.cancelNsPerOrder = perCall(elapsedNs(start, Clock::now()), result.ordersAdded);
+
+        result.peakRssBytes = processMemory().peakRssBytes;
+        cache.reset();
+        result.seconds = static_cast<double>(elapsedNs(cellStart, Clock::now())) / 1e9;
+        return result;
+    }
+
+    void printHeader(const ScaleConfig& cfg)
+    {
+        if (cfg.csv)
+        {
+            std::cout << "orders,securities,companies,ids,status,orders_added,add_ns_per_order,match_ns_per_query,"
+                "cancel_ns_per_order,seconds,baseline_rss_bytes,rss_after_add_bytes,peak_rss_bytes,"
+                "accounted_bytes,accounted_bytes_per_order,rss_bytes_per_order,peak_bytes_per_order\n";
+            return;
+        }
+        std::cout << std::right << std::setw(11) << "orders" << std::setw(11) << "securities"
+            << std::setw(11) << "companies" << std::setw(8) << "ids" << std::setw(9) << "status"
+            << std::setw(12) << "added" << std::setw(11) << "add ns" << std::setw(14) << "match ns"
+            << std::setw(11) << "cancel ns" << std::setw(10) << "seconds" << std::setw(11) << "peak MB"
+            << std::setw(11) << "acct B/o" << std::setw(10) << "rss B/o" << std::setw(10) << "peak B/o" << '\n';
+    }
+
+    void printCell(const ScaleConfig& cfg, const CellResult& r)
+    {
+        const auto grownBy{
+            [&](std::size_t bytes) { return bytes > r.baselineRssBytes ? bytes - r.baselineRssBytes : 0; }
+        };
+        const auto accountedPerOrder{perCall(r.memory.total(), r.ordersAdded)};
+        const auto rssPerOrder{perCall(grownBy(r.rssAfterAddBytes), r.ordersAdded)};
+        const auto peakPerOrder{perCall(grownBy(r.peakRssBytes), r.ordersAdded)};
+        const auto* ids{r.cell.sparse ? "sparse" : "dense"};
+        if (cfg.csv)
+        {
+            std::cout << r.cell.orders << ',' << r.cell.securities << ',' << r.cell.companies << ',' << ids << ','
+                << statusName(r.status) << ',' << r.ordersAdded << ',' << r.addNsPerOrder << ','
+                << r.matchNsPerQuery << ',' << r.cancelNsPerOrder << ',' << r.seconds << ','
+                << r.baselineRssBytes << ',' << r.rssAfterAddBytes << ',' << r.peakRssBytes << ','
+                << r.memory.total() << ',' << accountedPerOrder << ',' << rssPerOrder << ',' << peakPerOrder
+                << std::endl;
+            return;
+        }
+        std::cout << std::right << std::setw(11) << r.cell.orders << std::setw(11) << r.cell.securities
+            << std::setw(11) << r.cell.companies << std::setw(8) << ids << std::setw(9) << statusName(r.status)
+            << std::setw(12) << r.ordersAdded
+            << std::fixed << std::setprecision(1)
+            << std::setw(11) << r.addNsPerOrder << std::setw(14) << r.matchNsPerQuery
+            << std::setw(11) << r.cancelNsPerOrder << std::setw(10) << r.seconds
+            << std::setw(11) << static_cast<double>(r.peakRssBytes) / (1024.0 * 1024.0)
+            << std::setprecision(0) << std::setw(11) << accountedPerOrder << std::setw(10) << rssPerOrder
+            << std::setw(10) << peakPerOrder << std::endl;
+        if (cfg.memoryBreakdown && r.status != CellStatus::Skipped)
+        {
+            order_cache::memory::printMemoryUsage(std::cout, r.memory, r.ordersAdded);
+        }
+    }
+
+    // "250000", "10k", "1M", "2G"
+    [[nodiscard]] uint64_t parseCount(const std::string& value)
+    {
+        std::size_t end{0};
+        auto count{std::stoull(value, &end)};
+        if (end < value.size())
+        {
+            switch (value[end])
+            {
+            case 'k': case 'K': count *= 1'000; break;
+            case 'm': case 'M': count *= 1'000'000; break;
+            case 'g': case 'G': count *= 1'000'000'000; break;
+            default: throw std::invalid_argument("bad count " + value);
+            }
+        }
+        return count;
+    }
+
+    [[nodiscard]] std::vector<uint64_t> parseCounts(const std::string& list)
+    {
+        std::vector<uint64_t> counts;
+        std::size_t begin{0};
+        while (begin <= list.size())
+        {
+            const auto end{std::min(list.find(',', begin), list.size())};
+            if (end > begin)
+            {
+                counts.emplace_back(parseCount(list.substr(begin, end - begin)));
+            }
+            begin = end + 1;
+        }
+        return counts;
+    }
+
+    void printUsage(const char* program)
+    {
+        std::cout << "Usage: " << program << " [options]\n"
+            << "  --orders LIST       order counts, k/M/G suffixes allowed (default 1M,10M,100M)\n"
+            << "  --securities LIST   security counts (default 10,1k,100k,1M)\n"
+            << "  --companies LIST    company counts (default 10,1k,100k)\n"
+            << "  --users N           number of distinct users (default 1000)\n"
+            << "  --ids MODE          dense, sparse or both (default both)\n"
+            << "  --sparse-stride N   distance between consecutive sparse order ids (default 64)\n"
+            << "  --queries N         matching queries per cell, spread over the securities (default 1000)\n"
+            << "  --budget-mb N       stop a cell once its RSS grew by N MB (default half of the available memory)\n"
+            << "  --memory            print the OrderCache::memoryUsage() breakdown of every cell\n"
+            << "  --quick             small matrix: 100k and 1M orders, 10/1k/100k securities, 10/1k companies\n"
+            << "  --csv               print results as CSV\n";
+    }
+
+    bool parseArgs(int argc, char** argv, ScaleConfig& cfg)
+    {
+        for (int i = 1; i < argc; ++i)
+        {
+            const std::string arg{argv[i]};
+            const auto next{[&]() -> const char* { return (i + 1 < argc) ? argv[++i] : nullptr; }};
+            const auto nextCounts{
+                [&](std::vector<uint64_t>& out)
+                {
+                    const auto* value{next()};
+                    if (value == nullptr)
+                    {
+                        return false;
+                    }
+                    out = parseCounts(value);
+                    return !out.empty();
+                }
+            };
+            const auto nextCount{
+                [&](auto& out)
+                {
+                    const auto* value{next()};
+                    if (value == nullptr)
+                    {
+                        return false;
+                    }
+                    out = static_cast<std::remove_reference_t<decltype(out)>>(parseCount(value));
+                    return true;
+                }
+            };
+
+            if (arg == "--orders" && nextCounts(cfg.orders)) { continue; }
+            if (arg == "--securities" && nextCounts(cfg.securities)) { continue; }
+            if (arg == "--companies" && nextCounts(cfg.companies)) { continue; }
+            if (arg == "--users" && nextCount(cfg.users)) { continue; }
+            if (arg == "--sparse-stride" && nextCount(cfg.sparseStride)) { continue; }
+            if (arg == "--queries" && nextCount(cfg.matchQueries)) { continue; }
+            if (arg == "--budget-mb" && nextCount(cfg.memoryBudget))
+            {
+                cfg.memoryBudget *= 1024 * 1024;
+                continue;
+            }
+            if (arg == "--ids")
+            {
+                if (const auto* value{next()})
+                {
+                    const std::string mode{value};
+                    cfg.dense = mode == "dense" || mode == "both";
+                    cfg.sparse = mode == "sparse" || mode == "both";
+                    continue;
+                }
+            }
+            if (arg == "--quick")
+            {
+                cfg.orders = {100'000, 1'000'000};
+                cfg.securities = {10, 1'000, 100'000};
+                cfg.companies = {10, 1'000};
+                continue;
+            }
+            if (arg == "--memory")
+            {
+                cfg.memoryBreakdown = true;
+                continue;
+            }
+            if (arg == "--csv")
+            {
+                cfg.csv = true;
+                continue;
+            }
+            return false;
+        }
+        return (cfg.dense || cfg.sparse) && cfg.users > 0 && cfg.sparseStride > 0;
+    }
+}
+
+int main(int argc, char** argv)
+{
+    ScaleConfig cfg;
+    try
+    {
+        if (!parseArgs(argc, argv, cfg))
+        {
+            printUsage(argv[0]);
+            return 1;
+        }
+    }
+    catch (const std::exception&)
+    {
+        printUsage(argv[0]);
+        return 1;
+    }
+
+    const auto budget{cfg.memoryBudget != 0 ? cfg.memoryBudget : availableMemoryBytes() / 2};
+    if (!cfg.csv)
+    {
+        std::cout << "[     INFO ] users=" << cfg.users << " sparse stride=" << cfg.sparseStride
+            << " matching queries per cell=" << cfg.matchQueries
+            << " RSS budget per cell=" << budget / (1024 * 1024) << "MB"
+            << (resetPeakRss() ? "" : " (peak RSS cannot be reset, peaks are process wide)") << '\n'
+            << "[     INFO ] ns are per call; per added order: acct B/o is OrderCache::memoryUsage(), rss B/o the RSS"
+            " growth once every order is added, peak B/o the peak RSS growth of the whole cell\n";
+    }
+
+    printHeader(cfg);
+    // shapes that went over budget are not retried with more orders
+    std::set<std::tuple<uint64_t, uint64_t, bool>> overBudget;
+    for (const auto orders : cfg.orders)
+    {
+        for (const auto sparse : {false, true})
+        {
+            if ((sparse && !cfg.sparse) || (!sparse && !cfg.dense))
+            {
+                continue;
+            }
+            for (const auto securities : cfg.securities)
+            {
+                for (const auto companies : cfg.companies)
+                {
+                    const Cell cell{orders, securities, companies, sparse};
+                    const auto shape{std::make_tuple(securities, companies, sparse)};
+                    if (overBudget.count(shape) != 0)
+                    {
+                        CellResult skipped{cell, CellStatus::Skipped};
+                        printCell(cfg, skipped);
+                        continue;
+                    }
+
+                    const auto result{runCell(cfg, cell, budget)};
+                    if (result.status == CellStatus::OverBudget)
+                    {
+                        overBudget.insert(shape);
+                    }
+                    printCell(cfg, result);
+                }
+            }
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,164 @@
+#pragma once
+
+#include "FlatHashMap.h"
+#include "LatencyHistogram.h"
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <iomanip>
+#include <ostream>
+#include <vector>
+
+namespace order_cache::stats
+{
+    // Open addressing tables report slots as buckets and probe lengths as chains
+    struct HashTableStats
+    {
+        std::size_t keys{0};
+        std::size_t buckets{0};
+        float loadFactor{0};
+        float maxLoadFactor{0};
+        std::size_t usedBuckets{0};
+        std::size_t maxChainLength{0};
+        double meanChainLength{0}; // over the keys, 1.0 means every key sits in its home slot
+    };
+
+    // Distribution of the per-key order list lengths of one secondary index
+    struct KeyLengthStats
+    {
+        static constexpr std::size_t LOG2_BUCKETS{24};
+
+        std::size_t minLength{0};
+        std::size_t maxLength{0};
+        double meanLength{0};
+        std::size_t p50Length{0};
+        std::size_t p99Length{0};
+        // lengthsLog2[i] counts keys with a list length in [2^i, 2^(i+1)), the last bucket is open ended
+        std::array<std::size_t, LOG2_BUCKETS> lengthsLog2{};
+    };
+
+    struct IndexStats
+    {
+        HashTableStats table{};
+        KeyLengthStats lengths{};
+        std::size_t usedEntries{0};
+        std::size_t reservedEntries{0};
+        std::size_t reservedUnusedBytes{0};
+        bool built{true}; // lazily built indexes stay empty until their first query
+    };
+
+    struct OrderCacheStats
+    {
+        std::array<uint64_t, metrics::LatencyHistograms::OPERATIONS> operationCounts{};
+        uint64_t ordersAdded{0};
+        uint64_t ordersCancelled{0};
+        uint64_t duplicateOrdersIgnored{0};
+
+        std::size_t liveOrders{0};
+        std::size_t storageSlots{0}; // slots of the id window, from its start up to the highest id held
+        std::size_t storageCapacity{0}; // slots the ring can hold before it reallocates
+
+        IndexStats userIndex{};
+        IndexStats securityIndex{};
+        std::size_t qtyLevels{0}; // levels of every security side, 0 while the quantity index is not built
+
+        [[nodiscard]] uint64_t operationCount(metrics::Operation op) const noexcept
+        {
+            return operationCounts[static_cast<std::size_t>(op)];
+        }
+    };
+
+    template <typename Value>
+    [[nodiscard]] HashTableStats hashTableStats(const storage::FlatHashMap<Value>& map)
+    {
+        HashTableStats result;
+        result.keys = map.size();
+        result.buckets = map.slotCount();
+        result.loadFactor = static_cast<float>(map.loadFactor());
+        result.maxLoadFactor = static_cast<float>(map.maxLoadFactor());
+        result.usedBuckets = map.size();
+
+        std::size_t probed{0};
+        map.forEachProbeLength(
+            [&](std::size_t length)
+            {
+                probed += length;
+                result.maxChainLength = std::max(result.maxChainLength, length);
+            });
+        result.meanChainLength = result.keys == 0
+                                     ? 0.0
+                                     : static_cast<double>(probed) / static_cast<double>(result.keys);
+        return result;
+    }
+
+    [[nodiscard]] inline KeyLengthStats keyLengthStats(std::vector<std::size_t> lengths)
+    {
+        KeyLengthStats result;
+        if (lengths.empty())
+        {
+            return result;
+        }
+
+        std::sort(lengths.begin(), lengths.end());
+        std::size_t total{0};
+        for (const auto length : lengths)
+        {
+            total += length;
+            const auto bucket{length == 0 ? 0 : metrics::highestBit(length)};
+            ++result.lengthsLog2[std::min<std::size_t>(bucket, KeyLengthStats::LOG2_BUCKETS - 1)];
+        }
+        result.minLength = lengths.front();
+        result.maxLength = lengths.back();
+        result.meanLength = static_cast<double>(total) / static_cast<double>(lengths.size());
+        result.p50Length = lengths[(lengths.size() - 1) / 2];
+        result.p99Length = lengths[(lengths.size() - 1) * 99 / 100];
+        return result;
+    }
+
+    inline void printIndexStats(std::ostream& os, const char* name, const IndexStats& index)
+    {
+        if (!index.built)
+        {
+            os << name << ": not built\n";
+            return;
+        }
+        const auto& t{index.table};
+        const auto& l{index.lengths};
+        os << name << ": keys=" << t.keys << " buckets=" << t.buckets
+            << std::fixed << std::setprecision(2)
+            << " load=" << t.loadFactor << "/" << t.maxLoadFactor
+            << " probe(mean/max)=" << t.meanChainLength << "/" << t.maxChainLength << '\n'
+            << "  list length min/p50/mean/p99/max=" << l.minLength << "/" << l.p50Length << "/" << l.meanLength
+            << "/" << l.p99Length << "/" << l.maxLength << '\n'
+            << "  entries used/reserved=" << index.usedEntries << "/" << index.reservedEntries
+            << " reserved unused bytes=" << index.reservedUnusedBytes << '\n'
+            << "  length histogram (log2):";
+        for (std::size_t i = 0; i < l.lengthsLog2.size(); ++i)
+        {
+            if (l.lengthsLog2[i] != 0)
+            {
+                os << " [" << (std::size_t{1} << i) << ",)=" << l.lengthsLog2[i];
+            }
+        }
+        os << '\n';
+    }
+
+    inline void printStats(std::ostream& os, const OrderCacheStats& stats)
+    {
+        os << "operations:";
+        for (std::size_t i = 0; i < stats.operationCounts.size(); ++i)
+        {
+            os << ' ' << metrics::operationName(static_cast<metrics::Operation>(i)) << '='
+                << stats.operationCounts[i];
+        }
+        os << '\n'
+            << "orders: live=" << stats.liveOrders << " added=" << stats.ordersAdded
+            << " cancelled=" << stats.ordersCancelled << " duplicates ignored=" << stats.duplicateOrdersIgnored
+            << '\n'
+            << "storage: slots=" << stats.storageSlots << " capacity=" << stats.storageCapacity << '\n';
+        printIndexStats(os, "user index", stats.userIndex);
+        printIndexStats(os, "security index", stats.securityIndex);
+        os << "qty index: levels=" << stats.qtyLevels << '\n';
+    }
+}
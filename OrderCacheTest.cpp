@@ -3,7 +3,13 @@
 #include <random>
 #include <chrono>
 #include <iostream>
+#include <sstream>
+#include <unordered_map>
+#include "AllocationTracker.h"
 #include "OrderCache.h"
+#include "OrderGenerator.h"
+#include "Tracing.h"
+#include "WorkloadGenerator.h"
 #include "gtest/gtest.h"
 
 using namespace std::chrono_literals;
@@ -99,6 +105,17 @@ protected:
         return orders;
     }
 
+    // Skewed flow: a few securities, users and companies carry most of the orders
+    static order_cache::workload::GeneratorConfig skewedConfig()
+    {
+        order_cache::workload::GeneratorConfig config;
+        config.users = {NUM_USERS, 1.2};
+        config.companies = {NUM_COMPANIES, 1.0};
+        config.securities = {NUM_SECURITIES, 1.1};
+        config.userBelongsToOneCompany = true;
+        return config;
+    }
+
     static void SetUpTestCase()
     {
         const char* BLUE_COLOR = "\033[34m";
@@ -877,6 +894,30 @@ TEST_F(OrderCacheTest, EdgeCases_CancelOrdersForUser_AcrossMultipleSecuritiesSho
     ASSERT_EQ(cache.getMatchingSizeForSecurity("SecId3"), 0);
 }
 
+// EdgeCases: Canceling orders for users whose orders were stored before the order storage grew
+TEST_F(OrderCacheTest, EdgeCases_CancelOrdersForUser_AfterStorageGrowthShouldRemoveAll)
+{
+    CHECK_GLOBAL_FAILURE_FLAG();
+
+    // short names live inside the stored orders and move with them
+    for (int i = 0; i < 100; ++i)
+    {
+        cache.addOrder(Order{"OrdId" + std::to_string(i), "SecId1", i % 2 == 0 ? "Buy" : "Sell", 100,
+            "User" + std::to_string(i % 10), "Company" + std::to_string(i % 3)});
+    }
+
+    // an id past the preallocated storage makes it reallocate and move every stored order
+    cache.addOrder(Order{"OrdId1048576", "SecId1", "Buy", 100, "User0", "Company0"});
+
+    for (int user = 0; user < 10; ++user)
+    {
+        cache.cancelOrdersForUser("User" + std::to_string(user));
+    }
+
+    ASSERT_TRUE(cache.getAllOrders().empty());
+    ASSERT_EQ(cache.getMatchingSizeForSecurity("SecId1"), 0);
+}
+
 // EdgeCases: Test that canceling orders with an empty security ID
 TEST_F(OrderCacheTest, EdgeCases_CancelOrdersForSecIdWithMinimumQty_EmptySecurityId)
 {
@@ -1078,217 +1119,1799 @@ TEST_F(OrderCacheTest, EdgeCases_GetAllOrders_ResultNotModifiableExternally)
     ASSERT_EQ(ordersAfter[0].orderId(), "OrdId1");
 }
 
-// Performance: Add and match 1,000 orders
-TEST_F(OrderCacheTest, Performance_SmallDataset_1KOrders)
+// Storage: the alive bitmap tracks presence across word boundaries and iterates live slots in order
+TEST_F(OrderCacheTest, Storage_AliveBitmap_IteratesLiveSlotsAcrossWords)
 {
     CHECK_GLOBAL_FAILURE_FLAG();
 
-    unsigned int NUM_ORDERS = 1000;
-    std::vector<Order> orders = generateOrders(NUM_ORDERS);
-    auto start = std::chrono::high_resolution_clock::now();
-
-    // Add orders to the cache
-    for (int i = 0; i < orders.size(); i++)
+    order_cache::storage::OrderIndexedStorage storage;
+    for (const uint64_t index : {0, 1000, 64, 130, 63})
     {
-        cache.addOrder(orders[i]);
+        storage.addOrder(Order{"OrdId" + std::to_string(index), "SecId1", "Buy", 100, "User1", "Comp1"}, index);
     }
+    storage.cancelOrder(130);
+
+    ASSERT_EQ(storage.size(), 4);
+    ASSERT_EQ(storage.slots(), 1001);
+    ASSERT_TRUE(storage.hasOrder(63));
+    ASSERT_TRUE(storage.hasOrder(64));
+    ASSERT_FALSE(storage.hasOrder(65));
+    ASSERT_FALSE(storage.hasOrder(130));
+    ASSERT_FALSE(storage.hasOrder(5000));
+
+    std::vector<uint64_t> visited;
+    storage.forEachOrder([&](uint64_t index)
+    {
+        ASSERT_EQ(storage.order(index).orderId(), "OrdId" + std::to_string(index));
+        visited.emplace_back(index);
+    });
+    ASSERT_EQ(visited, (std::vector<uint64_t>{0, 63, 64, 1000}));
+    ASSERT_EQ(storage.getAllOrders().size(), 4);
+}
 
-    // Get matching size for every security and measure the time it takes
-    for (const auto& secId : secIds)
+// Storage: the huge page allocator maps only large blocks and falls back to operator new otherwise
+TEST_F(OrderCacheTest, Storage_HugePageAllocator_MapsLargeBlocksOnly)
+{
+    CHECK_GLOBAL_FAILURE_FLAG();
+
+    using order_cache::alloc::HUGE_PAGE_BYTES;
+    order_cache::alloc::HugePageAllocator<uint64_t> allocator;
+    ASSERT_EQ(allocator.usesHugePages(), order_cache::alloc::HUGE_PAGES_ENABLED);
+
+    const auto& counters{order_cache::alloc::hugePageCounters()};
+    const auto mappings{counters.explicitMappings + counters.transparentMappings + counters.regularMappings};
     {
-        cache.getMatchingSizeForSecurity(secId);
+        order_cache::alloc::AllocationScope scope;
+        const auto small{HUGE_PAGE_BYTES / sizeof(uint64_t) / 4};
+        auto* p{allocator.allocate(small)};
+        p[small - 1] = 1;
+        allocator.deallocate(p, small);
+        ASSERT_EQ(scope.allocations(), 1);
     }
-    auto end = std::chrono::high_resolution_clock::now();
-    auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(end - start).count();
-
-    double ncu = duration / benchmark_time; // Calculate the NCU based on benchmark
 
-    // Display the result
-    std::cout << BLUE_COLOR << "[     INFO ] Matched " << NUM_ORDERS << " orders in " << ncu << " NCUs (" << duration <<
-        "ms)" << RESET_COLOR << std::endl;
-    ASSERT_LE(ncu, 1500);
+    order_cache::storage::SlotArray<uint64_t> large(3 * HUGE_PAGE_BYTES / sizeof(uint64_t) + 1, 7);
+    ASSERT_EQ(large.back(), 7);
+    const auto mapped{counters.explicitMappings + counters.transparentMappings + counters.regularMappings};
+    ASSERT_EQ(mapped - mappings, allocator.usesHugePages() ? 1 : 0);
+    if (allocator.usesHugePages())
+    {
+        ASSERT_EQ(reinterpret_cast<uintptr_t>(large.data()) % HUGE_PAGE_BYTES, 0);
+        ASSERT_EQ(order_cache::memory::vectorHeapBytes(large), 4 * HUGE_PAGE_BYTES);
+    }
 }
 
-// Performance: Add and match 5,000 orders
-TEST_F(OrderCacheTest, Performance_SmallDataset_5KOrders)
+// Storage: the id window slides past cancelled low ids, stragglers move to the overflow map
+TEST_F(OrderCacheTest, Storage_SlidingWindow_AdvancesPastDeadIdsAndKeepsStragglers)
 {
     CHECK_GLOBAL_FAILURE_FLAG();
 
-    unsigned int NUM_ORDERS = 5000;
-    std::vector<Order> orders = generateOrders(NUM_ORDERS);
-    auto start = std::chrono::high_resolution_clock::now();
-
-    // Add orders to the cache
-    for (int i = 0; i < orders.size(); i++)
+    constexpr uint64_t ORDERS{64 * 256};
+    order_cache::storage::OrderIndexedStorage storage;
+    const auto add{
+        [&](uint64_t index)
+        {
+            storage.addOrder(Order{"OrdId" + std::to_string(index), "SecId1", "Buy", 100, "User1", "Comp1"}, index);
+        }
+    };
+    for (uint64_t index = 0; index < ORDERS; ++index)
     {
-        cache.addOrder(orders[i]);
+        add(index);
     }
 
-    // Get matching size for every security and measure the time it takes
-    for (const auto& secId : secIds)
+    // everything but one straggler in the oldest quarter is cancelled, the start moves without copying slots
+    const auto* newest{&storage.cold(ORDERS - 1)};
+    for (uint64_t index = 0; index < ORDERS / 4; ++index)
     {
-        cache.getMatchingSizeForSecurity(secId);
+        if (index != 5)
+        {
+            storage.cancelOrder(index);
+        }
     }
-    auto end = std::chrono::high_resolution_clock::now();
-    auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(end - start).count();
+    ASSERT_EQ(storage.windowStart(), ORDERS / 4);
+    ASSERT_EQ(storage.slots(), ORDERS - ORDERS / 4);
+    ASSERT_EQ(&storage.cold(ORDERS - 1), newest);
+    // the retired slots take the next ids, the ring does not grow
+    const auto capacity{storage.capacity()};
+    for (uint64_t index = ORDERS; index < ORDERS + ORDERS / 8; ++index)
+    {
+        add(index);
+    }
+    ASSERT_EQ(storage.capacity(), capacity);
+    ASSERT_EQ(&storage.cold(ORDERS - 1), newest);
+    for (uint64_t index = ORDERS; index < ORDERS + ORDERS / 8; ++index)
+    {
+        storage.cancelOrder(index);
+    }
+    ASSERT_EQ(storage.overflowOrders(), 1);
+    ASSERT_TRUE(storage.hasOrder(5));
+    ASSERT_EQ(storage.cold(5).orderId, "OrdId5");
+    ASSERT_EQ(storage.hot(5).orderIndex, 5);
+    ASSERT_FALSE(storage.hasOrder(6));
+
+    // ids below the window are added to the overflow map, export stays in id order
+    add(6);
+    ASSERT_EQ(storage.overflowOrders(), 2);
+    const auto orders{storage.getAllOrders()};
+    ASSERT_EQ(orders.size(), ORDERS - ORDERS / 4 + 2);
+    ASSERT_EQ(orders[0].orderId(), "OrdId5");
+    ASSERT_EQ(orders[1].orderId(), "OrdId6");
+    ASSERT_EQ(orders[2].orderId(), "OrdId" + std::to_string(ORDERS / 4));
+
+    // the segment keeps resolving the handles of moved stragglers
+    storage.cancelOrder(5);
+    storage.cancelOrder(6);
+    ASSERT_EQ(storage.overflowOrders(), 0);
+    for (uint64_t index = ORDERS / 4; index < ORDERS; ++index)
+    {
+        storage.cancelOrder(index);
+    }
+    ASSERT_EQ(storage.size(), 0);
+    ASSERT_EQ(storage.slots(), 0);
+    ASSERT_EQ(storage.segment("SecId1")->size(), 0);
+
+    // an empty storage restarts its window at the next id, even below the previous end
+    add(ORDERS + 10);
+    ASSERT_TRUE(storage.hasOrder(ORDERS + 10));
+    ASSERT_EQ(storage.slots(), 11);
+}
 
-    double ncu = duration / benchmark_time; // Calculate the NCU based on benchmark
+// Storage: an empty storage starts its window at the word of the next id, however large the id is
+TEST_F(OrderCacheTest, Storage_SlidingWindow_EmptyStorageRestartsAtTheNextId)
+{
+    CHECK_GLOBAL_FAILURE_FLAG();
 
-    // Display the result
-    std::cout << BLUE_COLOR << "[     INFO ] Matched " << NUM_ORDERS << " orders in " << ncu << " NCUs (" << duration <<
-        "ms)" << RESET_COLOR << std::endl;
-    ASSERT_LE(ncu, 1500);
+    cache.addOrder(Order{"OrdId50000000", "SecId1", "Buy", 100, "User1", "Company1"});
+    cache.addOrder(Order{"OrdId50000100", "SecId1", "Sell", 100, "User2", "Company2"});
+    ASSERT_EQ(cache.stats().storageSlots, 50000101 - 50000000 / 64 * 64);
+    const auto usage{cache.memoryUsage().storage};
+    ASSERT_LT(usage.slotHandles + usage.coldSlots + usage.aliveBitmap, 64 * 1024);
+
+    // the book drains, the ids keep rising
+    cache.cancelOrder("OrdId50000000");
+    cache.cancelOrder("OrdId50000100");
+    cache.addOrder(Order{"OrdId90000007", "SecId1", "Buy", 100, "User1", "Company1"});
+    ASSERT_EQ(cache.stats().storageSlots, 90000008 - 90000007 / 64 * 64);
+    ASSERT_EQ(cache.memoryUsage().storage.coldSlots, usage.coldSlots);
+
+    // and a lower id is not an overflow straggler either
+    cache.cancelOrder("OrdId90000007");
+    cache.addOrder(Order{"OrdId3", "SecId1", "Sell", 100, "User2", "Company2"});
+    ASSERT_EQ(cache.stats().storageSlots, 4);
+    ASSERT_EQ(cache.getAllOrders().size(), 1);
+    ASSERT_EQ(cache.getMatchingSizeForSecurity("SecId1"), 0);
 }
 
-// Performance: Add and match 10,000 orders
-TEST_F(OrderCacheTest, Performance_MediumDataset_10KOrders)
+// Storage: with only overflow orders left, the window restarts at the next id instead of spanning the gap
+TEST_F(OrderCacheTest, Storage_SlidingWindow_RestartsPastOverflowOnlyStorage)
 {
     CHECK_GLOBAL_FAILURE_FLAG();
 
-    unsigned int NUM_ORDERS = 10000;
-    std::vector<Order> orders = generateOrders(NUM_ORDERS);
-    auto start = std::chrono::high_resolution_clock::now();
+    constexpr uint64_t ORDERS{64 * 256};
+    order_cache::storage::OrderIndexedStorage storage;
+    const auto add{
+        [&](uint64_t index)
+        {
+            storage.addOrder(Order{"OrdId" + std::to_string(index), "SecId1", "Buy", 100, "User1", "Comp1"}, index);
+        }
+    };
+    for (uint64_t index = 0; index < ORDERS; ++index)
+    {
+        add(index);
+    }
+    // the straggler moves to the overflow map, then the rest of the window drains
+    for (uint64_t index = 0; index < ORDERS; ++index)
+    {
+        if (index != 5)
+        {
+            storage.cancelOrder(index);
+        }
+    }
+    ASSERT_EQ(storage.overflowOrders(), 1);
+    ASSERT_EQ(storage.slots(), 0);
+
+    const auto capacity{storage.capacity()};
+    const auto coldSlots{storage.memoryUsage().coldSlots};
+    constexpr uint64_t FAR{uint64_t{1} << 40};
+    add(FAR);
+    ASSERT_EQ(storage.windowStart(), FAR);
+    ASSERT_EQ(storage.slots(), 1);
+    ASSERT_EQ(storage.capacity(), capacity);
+    ASSERT_EQ(storage.memoryUsage().coldSlots, coldSlots);
+
+    // the straggler is still found by its absolute id, ids in the dead gap go to the overflow map
+    ASSERT_TRUE(storage.hasOrder(5));
+    ASSERT_EQ(storage.cold(5).orderId, "OrdId5");
+    add(ORDERS);
+    ASSERT_EQ(storage.overflowOrders(), 2);
+    const auto orders{storage.getAllOrders()};
+    ASSERT_EQ(orders.size(), 3);
+    ASSERT_EQ(orders[0].orderId(), "OrdId5");
+    ASSERT_EQ(orders[1].orderId(), "OrdId" + std::to_string(ORDERS));
+    ASSERT_EQ(orders[2].orderId(), "OrdId" + std::to_string(FAR));
+    storage.cancelOrder(5);
+    storage.cancelOrder(ORDERS);
+    storage.cancelOrder(FAR);
+    ASSERT_EQ(storage.size(), 0);
+    ASSERT_EQ(storage.segment("SecId1")->size(), 0);
+}
 
-    // Add orders to the cache
-    for (int i = 0; i < orders.size(); i++)
+// Storage: long-lived orders left at random ids move aside, the window follows the ids still churning
+TEST_F(OrderCacheTest, Storage_SlidingWindow_MovesRandomLongLivedOrdersAside)
+{
+    CHECK_GLOBAL_FAILURE_FLAG();
+
+    constexpr uint64_t ORDERS{300'000};
+    constexpr uint64_t LIFETIME{10'000};
+    order_cache::storage::OrderIndexedStorage storage;
+    std::mt19937_64 rng{42};
+    std::vector<bool> kept(ORDERS, false);
+    std::size_t keptOrders{0};
+    std::size_t maxSlots{0};
+    for (uint64_t index = 0; index < ORDERS; ++index)
     {
-        cache.addOrder(orders[i]);
+        storage.addOrder(Order{"OrdId" + std::to_string(index), "SecId1", "Buy", 100, "User1", "Comp1"}, index);
+        // one in a thousand orders lives for the rest of the day
+        kept[index] = rng() % 1000 == 0;
+        keptOrders += kept[index] ? 1 : 0;
+        if (index >= LIFETIME)
+        {
+            if (!kept[index - LIFETIME])
+            {
+                storage.cancelOrder(index - LIFETIME);
+            }
+            maxSlots = std::max(maxSlots, storage.slots());
+        }
     }
 
-    // Get matching size for every security and measure the time it takes
-    for (const auto& secId : secIds)
+    // the window spans the orders added in the last lifetime, not every id since the first kept one
+    ASSERT_LT(maxSlots, 2 * LIFETIME);
+    ASSERT_GT(storage.overflowOrders(), keptOrders * 9 / 10);
+    ASSERT_LT(storage.capacity(), 4 * LIFETIME);
+
+    // the overflow orders stay reachable and export in id order
+    const auto orders{storage.getAllOrders()};
+    ASSERT_EQ(orders.size(), storage.size());
+    for (std::size_t i = 1; i < orders.size(); ++i)
     {
-        cache.getMatchingSizeForSecurity(secId);
+        ASSERT_LT(std::stoull(orders[i - 1].orderId().substr(5)), std::stoull(orders[i].orderId().substr(5)));
     }
-    auto end = std::chrono::high_resolution_clock::now();
-    auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(end - start).count();
+    for (uint64_t index = 0; index < ORDERS - LIFETIME; ++index)
+    {
+        ASSERT_EQ(storage.hasOrder(index), kept[index]);
+    }
+}
 
-    double ncu = duration / benchmark_time; // Calculate the NCU based on benchmark
+// Storage: the last 64 ids of the range are rejected, the largest one is the end marker of the order lists,
+// the ids below them are stored
+TEST_F(OrderCacheTest, Storage_SlidingWindow_TopOfTheIdRange)
+{
+    CHECK_GLOBAL_FAILURE_FLAG();
 
-    // Display the result
-    std::cout << BLUE_COLOR << "[     INFO ] Matched " << NUM_ORDERS << " orders in " << ncu << " NCUs (" << duration <<
-        "ms)" << RESET_COLOR << std::endl;
-    ASSERT_LE(ncu, 1500);
+    for (const auto* orderId : {"OrdId18446744073709551615", "OrdId18446744073709551552"})
+    {
+        ASSERT_THROW(cache.addOrder(Order{orderId, "SecId1", "Buy", 100, "User1", "Company1"}),
+                     std::invalid_argument);
+        ASSERT_THROW(cache.cancelOrder(orderId), std::invalid_argument);
+    }
+    ASSERT_TRUE(cache.getAllOrders().empty());
+
+    cache.addOrder(Order{"OrdId18446744073709551551", "SecId1", "Buy", 100, "User1", "Company1"});
+    cache.addOrder(Order{"OrdId18446744073709551488", "SecId1", "Sell", 100, "User2", "Company2"});
+    ASSERT_EQ(cache.getAllOrders().size(), 2);
+    ASSERT_EQ(cache.getAllOrders().back().orderId(), "OrdId18446744073709551551");
+    ASSERT_EQ(cache.getMatchingSizeForSecurity("SecId1"), 100);
+
+    cache.cancelOrdersForUser("User1");
+    cache.cancelOrder("OrdId18446744073709551488");
+    ASSERT_TRUE(cache.getAllOrders().empty());
 }
 
-// Performance: Add and match 50,000 orders
-TEST_F(OrderCacheTest, Performance_MediumDataset_50KOrders)
+// Storage: hot fields are packed and interned, the cold strings and the export rebuild the order
+TEST_F(OrderCacheTest, Storage_HotColdSplit_InternsAndRebuildsOrders)
 {
     CHECK_GLOBAL_FAILURE_FLAG();
 
-    unsigned int NUM_ORDERS = 50000;
-    std::vector<Order> orders = generateOrders(NUM_ORDERS);
-    auto start = std::chrono::high_resolution_clock::now();
+    // the company links fill the padding up to two entries per cache line
+    static_assert(sizeof(order_cache::storage::HotOrder) == 32);
+
+    order_cache::storage::OrderIndexedStorage storage;
+    storage.addOrder(Order{"OrdId3", "SecIdA", "Sell", 300, "User1", "CompX"}, 3);
+    storage.addOrder(Order{"OrdId1", "SecIdB", "Buy", 100, "User2", "CompX"}, 1);
+    storage.addOrder(Order{"OrdId2", "SecIdA", "Buy", 200, "User1", "CompY"}, 2);
+
+    ASSERT_EQ(storage.securities().size(), 2);
+    ASSERT_EQ(storage.companies().size(), 2);
+    const auto& hot{storage.hot(2)};
+    ASSERT_EQ(hot.orderIndex, 2);
+    ASSERT_EQ(storage.security(2), storage.security(3));
+    ASSERT_EQ(storage.securities().name(storage.security(2)), "SecIdA");
+    ASSERT_EQ(storage.companies().name(hot.company), "CompY");
+    ASSERT_EQ(hot.qty, 200);
+    ASSERT_EQ(hot.side, order_cache::storage::Side::Buy);
+    ASSERT_EQ(storage.cold(2).user, "User1");
+    ASSERT_EQ(storage.cold(2).orderId, "OrdId2");
+
+    const auto orders{storage.getAllOrders()};
+    ASSERT_EQ(orders.size(), 3);
+    ASSERT_EQ(orders[2].orderId(), "OrdId3");
+    ASSERT_EQ(orders[2].securityId(), "SecIdA");
+    ASSERT_EQ(orders[2].side(), "Sell");
+    ASSERT_EQ(orders[2].qty(), 300);
+    ASSERT_EQ(orders[2].user(), "User1");
+    ASSERT_EQ(orders[2].company(), "CompX");
+}
 
-    // Add orders to the cache
-    for (int i = 0; i < orders.size(); i++)
+// Storage: a security segment stays dense on removal and keeps one spare chunk
+TEST_F(OrderCacheTest, Storage_SecuritySegment_MovesLastIntoHoleAndReleasesChunks)
+{
+    CHECK_GLOBAL_FAILURE_FLAG();
+
+    using order_cache::storage::SecuritySegment;
+    constexpr auto CHUNK{SecuritySegment::CHUNK_ENTRIES};
+
+    SecuritySegment segment;
+    for (uint32_t i = 0; i < 3 * CHUNK; ++i)
     {
-        cache.addOrder(orders[i]);
+        ASSERT_EQ(segment.push(order_cache::storage::HotOrder{i, 0, i + 1}), i);
     }
+    ASSERT_EQ(segment.capacity(), 3 * CHUNK);
 
-    // Get matching size for every security and measure the time it takes
-    for (const auto& secId : secIds)
+    // the last entry fills the hole, removing the last entry reports itself
+    ASSERT_EQ(segment.remove(5), 3 * CHUNK - 1);
+    ASSERT_EQ(segment[5].orderIndex, 3 * CHUNK - 1);
+    ASSERT_EQ(segment.remove(segment.size() - 1), 3 * CHUNK - 2);
+
+    uint64_t qty{0};
+    segment.forEach([&](const order_cache::storage::HotOrder& order) { qty += order.qty; });
+    const uint64_t all{3 * CHUNK};
+    ASSERT_EQ(qty, all * (all + 1) / 2 - 6 - (all - 1));
+
+    while (segment.size() > CHUNK)
     {
-        cache.getMatchingSizeForSecurity(secId);
+        segment.remove(0);
     }
-    auto end = std::chrono::high_resolution_clock::now();
-    auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(end - start).count();
+    ASSERT_EQ(segment.capacity(), 2 * CHUNK);
+    while (!segment.empty())
+    {
+        segment.remove(0);
+    }
+    ASSERT_EQ(segment.capacity(), CHUNK);
+}
 
-    double ncu = duration / benchmark_time; // Calculate the NCU based on benchmark
+// Storage: company books keep their lists and per side sums while removals move entries around
+TEST_F(OrderCacheTest, Storage_SecuritySegment_KeepsCompanyBooksAcrossMoves)
+{
+    CHECK_GLOBAL_FAILURE_FLAG();
 
-    // Display the result
-    std::cout << BLUE_COLOR << "[     INFO ] Matched " << NUM_ORDERS << " orders in " << ncu << " NCUs (" << duration <<
-        "ms)" << RESET_COLOR << std::endl;
-    ASSERT_LE(ncu, 1500);
+    using order_cache::storage::HotOrder;
+    using order_cache::storage::NO_POSITION;
+    using order_cache::storage::Side;
+
+    order_cache::storage::SecuritySegment segment;
+    std::mt19937 rng{7};
+    for (uint32_t i = 0; i < 1000; ++i)
+    {
+        segment.push(HotOrder{i, i % 13, i + 1, i % 3 == 0 ? Side::Sell : Side::Buy});
+    }
+    for (int i = 0; i < 600; ++i)
+    {
+        segment.remove(static_cast<uint32_t>(rng() % segment.size()));
+    }
+
+    const auto check{[&]
+    {
+        uint32_t orders{0};
+        segment.forEachBook([&](const order_cache::storage::CompanyBook& book)
+        {
+            uint64_t buy{0};
+            uint64_t sell{0};
+            uint32_t count{0};
+            auto previous{NO_POSITION};
+            for (auto position{book.head}; position != NO_POSITION; position = segment[position].nextInBook)
+            {
+                const auto& order{segment[position]};
+                ASSERT_EQ(order.company, book.company);
+                ASSERT_EQ(order.prevInBook, previous);
+                (order.side == Side::Buy ? buy : sell) += order.qty;
+                previous = position;
+                ++count;
+            }
+            ASSERT_EQ(book.tail, previous);
+            ASSERT_EQ(book.orders, count);
+            ASSERT_EQ(book.buyQty, buy);
+            ASSERT_EQ(book.sellQty, sell);
+            orders += count;
+        });
+        ASSERT_EQ(orders, segment.size());
+    }};
+    check();
+    ASSERT_EQ(segment.books(), 13);
+
+    // draining companies keeps their books until the shrink
+    while (segment.book(0)->orders != 0)
+    {
+        segment.remove(segment.book(0)->head);
+    }
+    check();
+    segment.shrinkToFit();
+    ASSERT_EQ(segment.books(), 12);
+    ASSERT_EQ(segment.book(0), nullptr);
+    check();
 }
 
-// Performance: Add and match 100,000 orders
-TEST_F(OrderCacheTest, Performance_LargeDataset_100KOrders)
+// Storage: the flat user map keeps every key reachable through growth and backward shift erases
+TEST_F(OrderCacheTest, Storage_FlatHashMap_FindsKeysAcrossRehashAndErase)
 {
     CHECK_GLOBAL_FAILURE_FLAG();
 
-    unsigned int NUM_ORDERS = 100000;
-    std::vector<Order> orders = generateOrders(NUM_ORDERS);
-    auto start = std::chrono::high_resolution_clock::now();
+    order_cache::storage::FlatHashMap<uint64_t> map;
+    ASSERT_EQ(map.find("User0"), nullptr);
+    ASSERT_EQ(map.slotCount(), 0);
 
-    // Add orders to the cache
-    for (int i = 0; i < orders.size(); i++)
+    constexpr uint64_t KEYS{5000};
+    for (uint64_t i = 0; i < KEYS; ++i)
     {
-        cache.addOrder(orders[i]);
+        const auto [value, inserted]{map.tryEmplace("User" + std::to_string(i))};
+        ASSERT_TRUE(inserted);
+        *value = i;
     }
+    ASSERT_FALSE(map.tryEmplace("User7").second);
+    ASSERT_EQ(map.size(), KEYS);
+    ASSERT_LE(map.loadFactor(), map.maxLoadFactor());
 
-    // Get matching size for every security and measure the time it takes
-    for (const auto& secId : secIds)
+    // erase every other key, the survivors shift back and stay reachable
+    for (uint64_t i = 0; i < KEYS; i += 2)
     {
-        cache.getMatchingSizeForSecurity(secId);
+        ASSERT_TRUE(map.erase("User" + std::to_string(i)));
+    }
+    ASSERT_FALSE(map.erase("User0"));
+    for (uint64_t i = 0; i < KEYS; ++i)
+    {
+        const auto* value{map.find("User" + std::to_string(i))};
+        if (i % 2 == 0)
+        {
+            ASSERT_EQ(value, nullptr);
+        }
+        else
+        {
+            ASSERT_NE(value, nullptr);
+            ASSERT_EQ(*value, i);
+        }
     }
-    auto end = std::chrono::high_resolution_clock::now();
-    auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(end - start).count();
-
-    double ncu = duration / benchmark_time; // Calculate the NCU based on benchmark
 
-    // Display the result
-    std::cout << BLUE_COLOR << "[     INFO ] Matched " << NUM_ORDERS << " orders in " << ncu << " NCUs (" << duration <<
-        "ms)" << RESET_COLOR << std::endl;
-    ASSERT_LE(ncu, 1500);
+    uint64_t sum{0};
+    std::size_t maxProbe{0};
+    map.forEach([&](std::string_view, uint64_t value) { sum += value; });
+    map.forEachProbeLength([&](std::size_t length) { maxProbe = std::max(maxProbe, length); });
+    ASSERT_EQ(sum, (KEYS / 2) * (KEYS / 2));
+    ASSERT_LT(maxProbe, 32);
+
+    const auto slots{map.slotCount()};
+    map.shrinkToFit();
+    ASSERT_LT(map.slotCount(), slots);
+    ASSERT_EQ(*map.find("User4999"), 4999);
 }
 
-// Performance: Add and match 500,000 orders
-TEST_F(OrderCacheTest, Performance_LargeDataset_500KOrders)
+// Storage: growth migrates the old table a step per insert, every key stays reachable meanwhile
+TEST_F(OrderCacheTest, Storage_FlatHashMap_MigratesIncrementallyAfterGrowth)
 {
     CHECK_GLOBAL_FAILURE_FLAG();
 
-    unsigned int NUM_ORDERS = 500000;
-    std::vector<Order> orders = generateOrders(NUM_ORDERS);
-    auto start = std::chrono::high_resolution_clock::now();
+    using Map = order_cache::storage::FlatHashMap<uint64_t>;
+    Map map;
+    uint64_t next{0};
+    const auto insert{[&] { *map.tryEmplace("User" + std::to_string(next)).first = next; ++next; }};
 
-    // Add orders to the cache
-    for (int i = 0; i < orders.size(); i++)
+    // fill a table of 16 migration steps up to its load limit, the next insert grows it
+    const auto slots{16 * Map::MIGRATION_STEP_SLOTS};
+    map.reserve(slots / 8 * 7);
+    ASSERT_EQ(map.slotCount(), slots);
+    while (map.slotCount() == slots)
     {
-        cache.addOrder(orders[i]);
+        insert();
     }
+    ASSERT_TRUE(map.rehashing());
+    ASSERT_EQ(map.slotCount(), 3 * slots);
 
-    // Get matching size for every security and measure the time it takes
-    for (const auto& secId : secIds)
+    // erase a few keys that may still sit in the old table, erases leave the migration to the inserts
+    for (uint64_t i = 0; i < 64; i += 4)
     {
-        cache.getMatchingSizeForSecurity(secId);
+        ASSERT_TRUE(map.erase("User" + std::to_string(i)));
     }
-    auto end = std::chrono::high_resolution_clock::now();
-    auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(end - start).count();
+    ASSERT_TRUE(map.rehashing());
+    const auto steps{slots / Map::MIGRATION_STEP_SLOTS};
+    for (std::size_t i = 0; map.rehashing(); ++i)
+    {
+        ASSERT_LE(i, steps);
+        insert();
+        if (i % 4 == 0)
+        {
+            for (uint64_t k = 0; k < next; ++k)
+            {
+                const auto* value{map.find("User" + std::to_string(k))};
+                ASSERT_EQ(value == nullptr, k < 64 && k % 4 == 0) << k;
+                ASSERT_TRUE(value == nullptr || *value == k);
+            }
+        }
+    }
+    ASSERT_EQ(map.slotCount(), 2 * slots);
+    ASSERT_EQ(map.size(), next - 16);
+}
 
-    double ncu = duration / benchmark_time; // Calculate the NCU based on benchmark
+// Storage: user lists stay consistent when their head, middle and tail orders are cancelled and relinked
+TEST_F(OrderCacheTest, Storage_UserLists_UnlinkHeadMiddleAndTail)
+{
+    CHECK_GLOBAL_FAILURE_FLAG();
 
-    // Display the result
-    std::cout << BLUE_COLOR << "[     INFO ] Matched " << NUM_ORDERS << " orders in " << ncu << " NCUs (" << duration <<
-        "ms)" << RESET_COLOR << std::endl;
-    ASSERT_LE(ncu, 1500);
+    for (int i = 1; i <= 9; ++i)
+    {
+        cache.addOrder(Order{"OrdId" + std::to_string(i), "SecId1", "Buy", 100, i % 3 == 0 ? "User2" : "User1",
+            "Company1"});
+    }
+    // the user index is built lazily, an unknown user builds it so the cancels below unlink from the lists
+    cache.cancelOrdersForUser("UserUnknown");
+    ASSERT_TRUE(cache.stats().userIndex.built);
+
+    // head, middle and tail of User1, then the only order left of User2 after its head and tail
+    for (const auto* id : {"OrdId1", "OrdId4", "OrdId8", "OrdId3", "OrdId9", "OrdId6"})
+    {
+        cache.cancelOrder(id);
+    }
+    // the emptied User2 list took its key with it
+    ASSERT_EQ(cache.stats().userIndex.table.keys, 1);
+    // relinked at the tail, the emptied User2 list starts over
+    cache.addOrder(Order{"OrdId4", "SecId1", "Sell", 100, "User1", "Company1"});
+    cache.addOrder(Order{"OrdId9", "SecId1", "Sell", 100, "User2", "Company1"});
+
+    cache.cancelOrdersForUser("User1");
+    auto orders{cache.getAllOrders()};
+    std::sort(orders.begin(), orders.end(), [](const Order& a, const Order& b) { return a.orderId() < b.orderId(); });
+    ASSERT_EQ(orders.size(), 1);
+    ASSERT_EQ(orders[0].orderId(), "OrdId9");
+
+    cache.cancelOrdersForUser("User2");
+    ASSERT_TRUE(cache.getAllOrders().empty());
+    ASSERT_EQ(cache.stats().userIndex.table.keys, 0);
 }
 
-// Performance: Add and match 1,000,000 orders
-TEST_F(OrderCacheTest, Performance_VeryLargeDataset_1MOrders)
+// Storage: company books answer per company volumes, listings and cancels within one security
+TEST_F(OrderCacheTest, Storage_CompanyBooks_InspectAndCancelOneFirmInOneSecurity)
 {
     CHECK_GLOBAL_FAILURE_FLAG();
 
-    unsigned int NUM_ORDERS = 1000000;
-    std::vector<Order> orders = generateOrders(NUM_ORDERS);
-
+    cache.addOrder(Order{"OrdId1", "SecId1", "Buy", 100, "User1", "Company1"});
+    cache.addOrder(Order{"OrdId2", "SecId1", "Sell", 200, "User2", "Company2"});
+    cache.addOrder(Order{"OrdId3", "SecId1", "Sell", 300, "User3", "Company1"});
+    cache.addOrder(Order{"OrdId4", "SecId2", "Buy", 400, "User1", "Company1"});
+    cache.addOrder(Order{"OrdId5", "SecId1", "Buy", 500, "User2", "Company1"});
+
+    const auto volume{cache.getCompanyVolumeForSecurity("SecId1", "Company1")};
+    ASSERT_EQ(volume.buyQty, 600);
+    ASSERT_EQ(volume.sellQty, 300);
+    ASSERT_EQ(volume.orders, 3);
+    ASSERT_EQ(cache.getCompanyVolumeForSecurity("SecId2", "Company2").orders, 0);
+    ASSERT_EQ(cache.getCompanyVolumeForSecurity("SecId9", "Company1").orders, 0);
+
+    const auto orders{cache.getOrdersForSecIdAndCompany("SecId1", "Company1")};
+    ASSERT_EQ(orders.size(), 3);
+    ASSERT_EQ(orders[0].orderId(), "OrdId1");
+    ASSERT_EQ(orders[1].orderId(), "OrdId3");
+    ASSERT_EQ(orders[2].orderId(), "OrdId5");
 
-    auto first{orders.front()};
-    auto last{orders.back()};
+    cache.cancelOrdersForSecIdAndCompany("SecId1", "Company1");
+    ASSERT_EQ(cache.getCompanyVolumeForSecurity("SecId1", "Company1").orders, 0);
+    ASSERT_TRUE(cache.getOrdersForSecIdAndCompany("SecId1", "Company1").empty());
+    ASSERT_EQ(cache.getAllOrders().size(), 2);
+    ASSERT_EQ(cache.getCompanyVolumeForSecurity("SecId2", "Company1").buyQty, 400);
+    ASSERT_EQ(cache.getCompanyVolumeForSecurity("SecId1", "Company2").sellQty, 200);
+    ASSERT_EQ(cache.stats().operationCount(order_cache::metrics::Operation::CancelOrdersForSecIdAndCompany), 1);
 
+    // the user index learns about the cancels when it is built afterwards
+    cache.cancelOrdersForUser("User2");
+    ASSERT_EQ(cache.getAllOrders().size(), 1);
+    ASSERT_EQ(cache.getAllOrders()[0].orderId(), "OrdId4");
+}
 
-    auto start = std::chrono::high_resolution_clock::now();
+// Storage: company cancels leave exactly the orders of the other companies, with matching book sums
+TEST_F(OrderCacheTest, Storage_CompanyBooks_CancelOrdersForCompanyMatchesReference)
+{
+    CHECK_GLOBAL_FAILURE_FLAG();
 
-    // Add orders to the cache
-    for (int i = 0; i < orders.size(); i++)
+    auto orders{generateOrders(20000)};
+    std::unordered_map<std::string, Order> reference;
+    for (const auto& order : orders)
     {
-        cache.addOrder(orders[i]);
+        reference.emplace(order.orderId(), order);
+        cache.addOrder(order);
     }
+    const auto eraseIf{
+        [&](auto predicate)
+        {
+            for (auto it = reference.begin(); it != reference.end();)
+            {
+                it = predicate(it->second) ? reference.erase(it) : std::next(it);
+            }
+        }
+    };
 
-    // Get matching size for every security and measure the time it takes
-    for (const auto& secId : secIds)
+    // single cancels in between make the segments move entries of the companies still to be cancelled
+    std::uniform_int_distribution<std::size_t> orderDist(0, orders.size() - 1);
+    for (std::size_t c = 0; c < companies.size() / 2; ++c)
     {
-        cache.getMatchingSizeForSecurity(secId);
+        for (int i = 0; i < 200; ++i)
+        {
+            const auto& orderId{orders[orderDist(gen)].orderId()};
+            cache.cancelOrder(orderId);
+            reference.erase(orderId);
+        }
+        cache.cancelOrdersForCompany(companies[c]);
+        eraseIf([&](const Order& o) { return o.company() == companies[c]; });
+        cache.cancelOrdersForSecIdAndCompany(secIds[c], companies[c + 1]);
+        eraseIf([&](const Order& o) { return o.securityId() == secIds[c] && o.company() == companies[c + 1]; });
+    }
+    cache.cancelOrdersForCompany("CompanyUnknown");
+
+    ASSERT_EQ(cache.getAllOrders().size(), reference.size());
+    for (const auto& order : cache.getAllOrders())
+    {
+        ASSERT_EQ(reference.count(order.orderId()), 1) << order.orderId();
+    }
+    std::unordered_map<std::string, uint64_t> buyQty;
+    for (const auto& [_, order] : reference)
+    {
+        if (order.side() == "Buy")
+        {
+            buyQty[order.securityId() + "/" + order.company()] += order.qty();
+        }
+    }
+    for (const auto& secId : secIds)
+    {
+        for (const auto& company : companies)
+        {
+            const auto key{secId + "/" + company};
+            ASSERT_EQ(cache.getCompanyVolumeForSecurity(secId, company).buyQty, buyQty.count(key) ? buyQty[key] : 0)
+                << key;
+        }
+    }
+}
+
+// Storage: a filtered cancel removes exactly the orders matching side, qty range, user and company
+TEST_F(OrderCacheTest, Storage_FilteredCancel_SideRangeAndUserInSecurity)
+{
+    CHECK_GLOBAL_FAILURE_FLAG();
+
+    cache.addOrder(Order{"OrdId1", "SecId1", "Sell", 100, "User1", "Company1"});
+    cache.addOrder(Order{"OrdId2", "SecId1", "Sell", 300, "User2", "Company2"});
+    cache.addOrder(Order{"OrdId3", "SecId1", "Sell", 500, "User1", "Company1"});
+    cache.addOrder(Order{"OrdId4", "SecId1", "Buy", 300, "User1", "Company1"});
+    cache.addOrder(Order{"OrdId5", "SecId2", "Sell", 300, "User1", "Company1"});
+    cache.addOrder(Order{"OrdId6", "SecId2", "Buy", 700, "User2", "Company2"});
+    ASSERT_EQ(cache.memoryUsage().qtyIndex, 0);
+
+    // Sell orders in SecId1 with qty in [200, 500]
+    cache.cancelOrders(OrderCache::CancelFilter{"SecId1", "Sell", 200, 500});
+    ASSERT_GT(cache.memoryUsage().qtyIndex, 0);
+    auto orders{cache.getAllOrders()};
+    std::vector<std::string> ids;
+    for (const auto& order : orders)
+    {
+        ids.emplace_back(order.orderId());
+    }
+    std::sort(ids.begin(), ids.end());
+    ASSERT_EQ(ids, (std::vector<std::string>{"OrdId1", "OrdId4", "OrdId5", "OrdId6"}));
+
+    // every order of User1 in SecId2, the user's orders in SecId1 stay
+    OrderCache::CancelFilter userInSecurity;
+    userInSecurity.securityId = "SecId2";
+    userInSecurity.user = "User1";
+    cache.cancelOrders(userInSecurity);
+    ASSERT_EQ(cache.getAllOrders().size(), 3);
+    ASSERT_EQ(cache.getMatchingSizeForSecurity("SecId2"), 0);
+
+    // unknown names and empty ranges cancel nothing, an unknown side throws
+    cache.cancelOrders(OrderCache::CancelFilter{"SecIdUnknown"});
+    cache.cancelOrders(OrderCache::CancelFilter{"SecId1", "", 400, 300});
+    cache.cancelOrders(OrderCache::CancelFilter{"SecId1", "Buy", 0, 1000, "UserUnknown"});
+    cache.cancelOrders(OrderCache::CancelFilter{"SecId1", "Buy", 0, 1000, "", "CompanyUnknown"});
+    ASSERT_EQ(cache.getAllOrders().size(), 3);
+    ASSERT_THROW(cache.cancelOrders(OrderCache::CancelFilter{"SecId1", "Short"}), std::invalid_argument);
+
+    // the company and an empty side reach both sides of the security
+    cache.cancelOrders(OrderCache::CancelFilter{"SecId1", "", 0, 1000, "", "Company1"});
+    orders = cache.getAllOrders();
+    ASSERT_EQ(orders.size(), 1);
+    ASSERT_EQ(orders[0].orderId(), "OrdId6");
+
+    // the first compact keeps the quantity index a filtered cancel used, the second finds it idle
+    cache.compact();
+    ASSERT_GT(cache.memoryUsage().qtyIndex, 0);
+    cache.compact();
+    ASSERT_EQ(cache.memoryUsage().qtyIndex, 0);
+    cache.cancelOrdersForSecIdWithMinimumQty("SecId2", 700);
+    ASSERT_TRUE(cache.getAllOrders().empty());
+}
+
+// Storage: the quantity index holds a level per live quantity, cancels erase the levels they drain
+TEST_F(OrderCacheTest, Storage_FilteredCancel_LevelsFollowLiveQuantities)
+{
+    CHECK_GLOBAL_FAILURE_FLAG();
+
+    constexpr unsigned int ORDERS{10000};
+    for (unsigned int i = 0; i < ORDERS; ++i)
+    {
+        cache.addOrder(Order{"OrdId" + std::to_string(i), "SecId1", i % 2 == 0 ? "Buy" : "Sell", i + 1,
+                             "User" + std::to_string(i % 7), "Company" + std::to_string(i % 3)});
+    }
+    ASSERT_EQ(cache.stats().qtyLevels, 0);
+
+    // no order has qty 0, the cancel only builds the index
+    cache.cancelOrders(OrderCache::CancelFilter{"SecId1", "Buy", 0, 0});
+    ASSERT_EQ(cache.stats().qtyLevels, ORDERS);
+
+    // single cancels, a user cancel and a filtered cancel all erase the levels they empty
+    for (unsigned int i = 0; i < ORDERS; i += 4)
+    {
+        cache.cancelOrder("OrdId" + std::to_string(i));
+    }
+    ASSERT_EQ(cache.stats().qtyLevels, ORDERS - ORDERS / 4);
+    cache.cancelOrders(OrderCache::CancelFilter{"SecId1", "Sell"});
+    ASSERT_EQ(cache.stats().qtyLevels, ORDERS / 4);
+    cache.cancelOrdersForUser("User3");
+    const auto remaining{cache.getAllOrders().size()};
+    ASSERT_LT(remaining, ORDERS / 4);
+    ASSERT_EQ(cache.stats().qtyLevels, remaining);
+
+    // quantities seen once and cancelled leave nothing behind
+    for (unsigned int i = 0; i < ORDERS; ++i)
+    {
+        const auto id{"OrdId" + std::to_string(ORDERS + i)};
+        cache.addOrder(Order{id, "SecId1", "Buy", ORDERS + i + 1, "User1", "Company1"});
+        cache.cancelOrder(id);
+    }
+    ASSERT_EQ(cache.stats().qtyLevels, remaining);
+
+    const auto levelMemory{cache.memoryUsage().qtyIndex};
+    cache.cancelOrders(OrderCache::CancelFilter{"SecId1", "", 1});
+    ASSERT_TRUE(cache.getAllOrders().empty());
+    ASSERT_EQ(cache.stats().qtyLevels, 0);
+    ASSERT_LT(cache.memoryUsage().qtyIndex, levelMemory);
+}
+
+// Storage: random filters pick every access path and always cancel what a reference filter selects
+TEST_F(OrderCacheTest, Storage_FilteredCancel_RandomFiltersMatchReference)
+{
+    CHECK_GLOBAL_FAILURE_FLAG();
+
+    // four deep securities, so short user lists, company books and narrow qty ranges all beat the scan
+    constexpr std::size_t SECURITIES{4};
+    std::vector<Order> orders;
+    for (const auto& order : generateOrders(20000))
+    {
+        orders.push_back(Order{order.orderId(), secIds[orders.size() % SECURITIES], order.side(), order.qty(),
+            order.user(), order.company()});
+    }
+    std::unordered_map<std::string, Order> reference;
+    const auto add{
+        [&](const Order& order)
+        {
+            reference.emplace(order.orderId(), order);
+            cache.addOrder(order);
+        }
+    };
+    for (std::size_t i = 0; i < orders.size() / 2; ++i)
+    {
+        add(orders[i]);
+    }
+
+    std::uniform_int_distribution<int> coin(0, 1);
+    std::uniform_int_distribution<unsigned int> qtyDist(0, 51 * ORDER_QTY_MULTIPLIER);
+    std::uniform_int_distribution<std::size_t> pick(0, 1 << 20);
+    std::size_t nextAdd{orders.size() / 2};
+    for (int round = 0; round < 300; ++round)
+    {
+        OrderCache::CancelFilter filter;
+        filter.securityId = secIds[pick(gen) % SECURITIES];
+        if (coin(gen) == 0)
+        {
+            filter.side = sides[pick(gen) % sides.size()];
+        }
+        if (coin(gen) == 0)
+        {
+            filter.minQty = qtyDist(gen);
+            filter.maxQty = filter.minQty + qtyDist(gen) / 4;
+        }
+        if (coin(gen) == 0)
+        {
+            filter.user = users[pick(gen) % users.size()];
+        }
+        if (coin(gen) == 0)
+        {
+            filter.company = companies[pick(gen) % companies.size()];
+        }
+        cache.cancelOrders(filter);
+        for (auto it = reference.begin(); it != reference.end();)
+        {
+            const auto& o{it->second};
+            const auto matches{
+                o.securityId() == filter.securityId && (filter.side.empty() || o.side() == filter.side) &&
+                o.qty() >= filter.minQty && o.qty() <= filter.maxQty &&
+                (filter.user.empty() || o.user() == filter.user) &&
+                (filter.company.empty() || o.company() == filter.company)
+            };
+            it = matches ? reference.erase(it) : std::next(it);
+        }
+
+        // adds and single cancels keep the lists moving between the filtered cancels
+        for (int i = 0; i < 30 && nextAdd < orders.size(); ++i)
+        {
+            add(orders[nextAdd++]);
+        }
+        const auto& orderId{orders[pick(gen) % nextAdd].orderId()};
+        cache.cancelOrder(orderId);
+        reference.erase(orderId);
+        if (round % 100 == 99)
+        {
+            cache.compact();
+        }
+    }
+
+    ASSERT_EQ(cache.getAllOrders().size(), reference.size());
+    for (const auto& order : cache.getAllOrders())
+    {
+        ASSERT_EQ(reference.count(order.orderId()), 1) << order.orderId();
+    }
+}
+
+// Storage: the user index is built by the first user cancel and dropped by a compact without user cancels
+TEST_F(OrderCacheTest, Storage_UserIndex_BuiltOnFirstUseAndDroppedWhenIdle)
+{
+    CHECK_GLOBAL_FAILURE_FLAG();
+
+    for (int i = 1; i <= 6; ++i)
+    {
+        cache.addOrder(Order{"OrdId" + std::to_string(i), "SecId1", "Buy", 100, i % 2 == 0 ? "User2" : "User1",
+            "Company1"});
+    }
+    cache.cancelOrder("OrdId3");
+    ASSERT_FALSE(cache.stats().userIndex.built);
+
+    // built from the live orders only, then kept up to date by adds and cancels
+    cache.cancelOrdersForUser("User1");
+    ASSERT_TRUE(cache.stats().userIndex.built);
+    ASSERT_EQ(cache.stats().userIndex.usedEntries, 3);
+    cache.addOrder(Order{"OrdId7", "SecId1", "Sell", 100, "User1", "Company1"});
+    cache.cancelOrder("OrdId2");
+    ASSERT_EQ(cache.stats().userIndex.usedEntries, 3);
+
+    // the first compact keeps the index a user cancel used, the second finds it idle
+    cache.compact();
+    ASSERT_TRUE(cache.stats().userIndex.built);
+    cache.compact();
+    ASSERT_FALSE(cache.stats().userIndex.built);
+    ASSERT_EQ(cache.memoryUsage().userIndex.total(), 0);
+
+    cache.cancelOrdersForUser("User2");
+    auto orders{cache.getAllOrders()};
+    ASSERT_EQ(orders.size(), 1);
+    ASSERT_EQ(orders[0].orderId(), "OrdId7");
+}
+
+// Workload: the shared generator produces the same flow for the same seed
+TEST_F(OrderCacheTest, Workload_OrderGenerator_DeterministicForSeed)
+{
+    CHECK_GLOBAL_FAILURE_FLAG();
+
+    order_cache::workload::OrderGenerator first{skewedConfig()};
+    order_cache::workload::OrderGenerator second{skewedConfig()};
+    const auto a{first.generate(1000)};
+    const auto b{second.generate(1000)};
+
+    ASSERT_EQ(a.size(), b.size());
+    for (size_t i = 0; i < a.size(); ++i)
+    {
+        ASSERT_EQ(a[i].orderId(), b[i].orderId());
+        ASSERT_EQ(a[i].securityId(), b[i].securityId());
+        ASSERT_EQ(a[i].side(), b[i].side());
+        ASSERT_EQ(a[i].qty(), b[i].qty());
+        ASSERT_EQ(a[i].user(), b[i].user());
+        ASSERT_EQ(a[i].company(), b[i].company());
+    }
+}
+
+// Workload: a strided id space produces sparse order ids the cache stores and cancels like dense ones
+TEST_F(OrderCacheTest, Workload_OrderGenerator_SparseOrderIds)
+{
+    CHECK_GLOBAL_FAILURE_FLAG();
+
+    auto config{skewedConfig()};
+    config.firstOrderId = 5;
+    config.orderIdStride = 1000;
+    order_cache::workload::OrderGenerator generator{config};
+    const auto orders{generator.generate(100)};
+
+    ASSERT_EQ(orders.front().orderId(), "OrdId5");
+    ASSERT_EQ(orders[1].orderId(), "OrdId1005");
+    ASSERT_EQ(orders.back().orderId(), "OrdId99005");
+    ASSERT_EQ(generator.nextOrderId(), 100005);
+
+    OrderCache cache;
+    for (const auto& order : orders)
+    {
+        cache.addOrder(order);
+    }
+    ASSERT_EQ(cache.getAllOrders().size(), orders.size());
+    for (size_t i = 0; i < orders.size(); i += 2)
+    {
+        cache.cancelOrder(orders[i].orderId());
+    }
+    ASSERT_EQ(cache.getAllOrders().size(), orders.size() / 2);
+}
+
+// Workload: Zipf popularity concentrates orders on the top ranked securities
+TEST_F(OrderCacheTest, Workload_OrderGenerator_ZipfSkewsTowardsHotSecurities)
+{
+    CHECK_GLOBAL_FAILURE_FLAG();
+
+    order_cache::workload::OrderGenerator generator{skewedConfig()};
+    const auto orders{generator.generate(100000)};
+
+    std::unordered_map<std::string, size_t> perSecurity;
+    for (const auto& order : orders)
+    {
+        ++perSecurity[order.securityId()];
+    }
+
+    // rank 0 is the most popular key, with exponent 1.1 the top 10 securities carry about half of the flow
+    const auto expectedTop10{generator.securityDistribution().headMass(10)};
+    size_t top10{0};
+    for (int i = 0; i < 10; ++i)
+    {
+        top10 += perSecurity["SecId" + std::to_string(i)];
+    }
+    ASSERT_GT(perSecurity["SecId0"], perSecurity["SecId100"]);
+    ASSERT_NEAR(static_cast<double>(top10) / orders.size(), expectedTop10, 0.02);
+}
+
+// Workload: side imbalance, qty distribution and fixed user companies are honoured
+TEST_F(OrderCacheTest, Workload_OrderGenerator_SideImbalanceAndQtyBounds)
+{
+    CHECK_GLOBAL_FAILURE_FLAG();
+
+    auto config{skewedConfig()};
+    config.buyRatio = 0.8;
+    config.qtyDistribution = order_cache::workload::QtyDistribution::PowerLawLots;
+    config.minLots = 2;
+    config.maxLots = 20;
+    order_cache::workload::OrderGenerator generator{config};
+    const auto orders{generator.generate(50000)};
+
+    size_t buys{0};
+    size_t smallestLot{0};
+    std::unordered_map<std::string, std::string> userCompany;
+    for (const auto& order : orders)
+    {
+        buys += order.side() == "Buy" ? 1 : 0;
+        smallestLot += order.qty() == 200 ? 1 : 0;
+        ASSERT_GE(order.qty(), 200);
+        ASSERT_LE(order.qty(), 2000);
+        ASSERT_EQ(order.qty() % 100, 0);
+
+        const auto [it, inserted]{userCompany.emplace(order.user(), order.company())};
+        ASSERT_EQ(it->second, order.company());
+    }
+    ASSERT_NEAR(static_cast<double>(buys) / orders.size(), 0.8, 0.01);
+    // power law lots: the smallest lot is the most frequent one by far
+    ASSERT_GT(smallestLot, orders.size() / 4);
+}
+
+// Workload: cancelling the hottest user and security of a skewed book keeps the cache consistent
+TEST_F(OrderCacheTest, Workload_SkewedFlow_HotKeyCancellationsStayConsistent)
+{
+    CHECK_GLOBAL_FAILURE_FLAG();
+
+    order_cache::workload::OrderGenerator generator{skewedConfig()};
+    const auto orders{generator.generate(20000)};
+    for (const auto& order : orders)
+    {
+        cache.addOrder(order);
+    }
+
+    cache.cancelOrdersForUser("User0");
+    cache.cancelOrdersForSecIdWithMinimumQty("SecId0", 2500);
+
+    size_t expected{0};
+    for (const auto& order : orders)
+    {
+        const bool cancelled{
+            order.user() == "User0" || (order.securityId() == "SecId0" && order.qty() >= 2500)
+        };
+        expected += cancelled ? 0 : 1;
+    }
+
+    const auto remaining{cache.getAllOrders()};
+    ASSERT_EQ(remaining.size(), expected);
+    for (const auto& order : remaining)
+    {
+        ASSERT_NE(order.user(), "User0");
+        ASSERT_FALSE(order.securityId() == "SecId0" && order.qty() >= 2500);
+    }
+}
+
+// Workload: the lifecycle stream interleaves every operation type and keeps the book in a steady state
+TEST_F(OrderCacheTest, Workload_LifecycleGenerator_InterleavesAllOperations)
+{
+    CHECK_GLOBAL_FAILURE_FLAG();
+
+    using namespace order_cache::workload;
+    LifecycleConfig config;
+    config.orders = skewedConfig();
+    config.meanLifetime = 2000;
+    config.mix.cancelUser = 1;
+    const auto stream{LifecycleGenerator{config}.generate(50000)};
+
+    std::unordered_map<OperationType, size_t> perType;
+    for (const auto& op : stream.operations)
+    {
+        ++perType[op.type];
+    }
+    ASSERT_EQ(stream.operations.size(), 50000);
+    for (const auto type : {
+             OperationType::Add, OperationType::Cancel, OperationType::Amend, OperationType::CancelUser,
+             OperationType::CancelMinQty, OperationType::Match
+         })
+    {
+        ASSERT_GT(perType[type], 0) << operationName(type);
+    }
+
+    // every order is added exactly once, order ids are strictly increasing
+    ASSERT_EQ(stream.orders.size(), perType[OperationType::Add] + perType[OperationType::Amend]);
+
+    // adds and expiries balance out below mix.add / total * meanLifetime live orders, bulk cancels of the hot
+    // users and securities keep the book under that bound instead of it growing with the stream
+    replay(cache, stream);
+    const auto live{cache.getAllOrders().size()};
+    ASSERT_GT(live, 300);
+    ASSERT_LT(live, 2000);
+}
+
+// Workload: replaying a lifecycle stream leaves exactly the orders a naive book would keep
+TEST_F(OrderCacheTest, Workload_LifecycleReplay_MatchesReferenceBook)
+{
+    CHECK_GLOBAL_FAILURE_FLAG();
+
+    using namespace order_cache::workload;
+    LifecycleConfig config;
+    config.orders = skewedConfig();
+    config.lifetime = LifetimeDistribution::Pareto;
+    config.meanLifetime = 3000;
+    config.mix.cancelUser = 2;
+    config.mix.cancelMinQty = 5;
+    const auto stream{LifecycleGenerator{config}.generate(30000)};
+
+    std::unordered_map<std::string, const Order*> reference;
+    const auto referenceApply{
+        [&](const Operation& op)
+        {
+            const auto eraseIf{
+                [&](auto predicate)
+                {
+                    for (auto it = reference.begin(); it != reference.end();)
+                    {
+                        it = predicate(*it->second) ? reference.erase(it) : std::next(it);
+                    }
+                }
+            };
+            switch (op.type)
+            {
+            case OperationType::Add:
+                reference.emplace(stream.orders[op.orderIndex].orderId(), &stream.orders[op.orderIndex]);
+                break;
+            case OperationType::Amend:
+                reference.erase(op.key);
+                reference.emplace(stream.orders[op.orderIndex].orderId(), &stream.orders[op.orderIndex]);
+                break;
+            case OperationType::Cancel:
+                reference.erase(op.key);
+                break;
+            case OperationType::CancelUser:
+                eraseIf([&](const Order& o) { return o.user() == op.key; });
+                break;
+            case OperationType::CancelMinQty:
+                eraseIf([&](const Order& o) { return o.securityId() == op.key && o.qty() >= op.minQty; });
+                break;
+            case OperationType::Match:
+                break;
+            }
+        }
+    };
+
+    for (const auto& op : stream.operations)
+    {
+        apply(cache, stream, op);
+        referenceApply(op);
+    }
+
+    const auto remaining{cache.getAllOrders()};
+    ASSERT_EQ(remaining.size(), reference.size());
+    for (const auto& order : remaining)
+    {
+        ASSERT_EQ(reference.count(order.orderId()), 1) << order.orderId();
+    }
+}
+
+// Metrics: log-linear buckets keep every percentile within the bucket precision
+TEST_F(OrderCacheTest, Metrics_LatencyHistogram_PercentilesWithinBucketPrecision)
+{
+    CHECK_GLOBAL_FAILURE_FLAG();
+
+    using order_cache::metrics::LatencyHistogram;
+    LatencyHistogram histogram;
+    ASSERT_EQ(histogram.percentile(99), 0);
+
+    for (uint64_t value = 1; value <= 100000; ++value)
+    {
+        histogram.record(value);
+    }
+    ASSERT_EQ(histogram.count(), 100000);
+    ASSERT_EQ(histogram.min(), 1);
+    ASSERT_EQ(histogram.max(), 100000);
+    ASSERT_NEAR(histogram.mean(), 50000.5, 0.01);
+
+    constexpr double PRECISION{1.0 / LatencyHistogram::SUB_BUCKETS};
+    for (const double p : {50.0, 90.0, 99.0, 99.9, 99.99})
+    {
+        const auto expected{p / 100.0 * 100000};
+        ASSERT_NEAR(static_cast<double>(histogram.percentile(p)), expected, expected * PRECISION) << p;
+    }
+    ASSERT_EQ(histogram.percentile(100), 100000);
+
+    // every value lands in a bucket whose bounds contain it
+    for (const uint64_t value : {0ull, 31ull, 32ull, 33ull, 1000ull, 123456789ull, ~0ull})
+    {
+        const auto bucket{LatencyHistogram::bucketOf(value)};
+        ASSERT_LT(bucket, LatencyHistogram::BUCKETS);
+        ASSERT_LE(LatencyHistogram::bucketLowerBound(bucket), value);
+        ASSERT_GE(LatencyHistogram::bucketUpperBound(bucket), value);
+    }
+}
+
+// Metrics: the cache records one sample per public call when histograms are compiled in
+TEST_F(OrderCacheTest, Metrics_LatencyHistograms_RecordEveryPublicCall)
+{
+    CHECK_GLOBAL_FAILURE_FLAG();
+
+    using order_cache::metrics::Operation;
+    cache.addOrder(Order{"OrdId1", "SecId1", "Buy", 100, "User1", "Company1"});
+    cache.addOrder(Order{"OrdId2", "SecId1", "Sell", 100, "User2", "Company2"});
+    ASSERT_THROW(cache.addOrder(Order{"OrdId3", "SecId1", "Sell", 0, "User2", "Company2"}), std::invalid_argument);
+    ASSERT_EQ(cache.getMatchingSizeForSecurity("SecId1"), 100);
+    cache.cancelOrdersForSecIdWithMinimumQty("SecId1", 500);
+    cache.cancelOrder("OrdId1");
+    cache.cancelOrdersForUser("User2");
+    ASSERT_TRUE(cache.getAllOrders().empty());
+
+    const auto& histograms{cache.latencyHistograms()};
+    const uint64_t enabled{order_cache::metrics::LATENCY_HISTOGRAMS_ENABLED ? 1u : 0u};
+    ASSERT_EQ(histograms[Operation::AddOrder].count(), 3 * enabled);
+    ASSERT_EQ(histograms[Operation::CancelOrder].count(), enabled);
+    ASSERT_EQ(histograms[Operation::CancelOrdersForUser].count(), enabled);
+    ASSERT_EQ(histograms[Operation::CancelOrdersForSecIdWithMinimumQty].count(), enabled);
+    ASSERT_EQ(histograms[Operation::GetMatchingSizeForSecurity].count(), enabled);
+    ASSERT_EQ(histograms[Operation::GetAllOrders].count(), enabled);
+
+    cache.resetLatencyHistograms();
+    ASSERT_EQ(cache.latencyHistograms()[Operation::AddOrder].count(), 0);
+
+    // disabled, the cache carries no bucket counters at all
+    static_assert(std::is_empty_v<order_cache::metrics::OperationLatencies<false>>);
+    if constexpr (!order_cache::metrics::LATENCY_HISTOGRAMS_ENABLED)
+    {
+        ASSERT_LT(sizeof(OrderCache), sizeof(order_cache::metrics::LatencyHistograms));
+    }
+}
+
+// Metrics: stats() reports operation counters, storage usage and index health
+TEST_F(OrderCacheTest, Metrics_Stats_ReportCountersAndIndexHealth)
+{
+    CHECK_GLOBAL_FAILURE_FLAG();
+
+    using order_cache::metrics::Operation;
+    cache.addOrder(Order{"OrdId1", "SecId1", "Buy", 100, "User1", "Company1"});
+    cache.addOrder(Order{"OrdId2", "SecId1", "Sell", 300, "User1", "Company2"});
+    cache.addOrder(Order{"OrdId3", "SecId1", "Sell", 500, "User2", "Company2"});
+    cache.addOrder(Order{"OrdId4", "SecId2", "Buy", 700, "User3", "Company3"});
+    cache.addOrder(Order{"OrdId4", "SecId2", "Buy", 700, "User3", "Company3"});
+    cache.cancelOrder("OrdId4");
+    cache.cancelOrder("OrdId4");
+    cache.getMatchingSizeForSecurity("SecId1");
+    // the user index is built by the first user cancel, even of an unknown user
+    ASSERT_FALSE(cache.stats().userIndex.built);
+    cache.cancelOrdersForUser("User9");
+
+    const auto stats{cache.stats()};
+    ASSERT_EQ(stats.operationCount(Operation::AddOrder), 5);
+    ASSERT_EQ(stats.operationCount(Operation::CancelOrder), 2);
+    ASSERT_EQ(stats.operationCount(Operation::CancelOrdersForUser), 1);
+    ASSERT_EQ(stats.operationCount(Operation::GetMatchingSizeForSecurity), 1);
+    ASSERT_EQ(stats.operationCount(Operation::GetAllOrders), 0);
+    ASSERT_EQ(stats.ordersAdded, 4);
+    ASSERT_EQ(stats.ordersCancelled, 1);
+    ASSERT_EQ(stats.duplicateOrdersIgnored, 1);
+    ASSERT_EQ(stats.liveOrders, 3);
+    ASSERT_GE(stats.storageSlots, 5);
+    ASSERT_GE(stats.storageCapacity, stats.storageSlots);
+
+    // User1 holds two orders, User2 one, the cancelled User3 order was never linked
+    ASSERT_TRUE(stats.userIndex.built);
+    ASSERT_EQ(stats.userIndex.table.keys, 2);
+    ASSERT_EQ(stats.userIndex.usedEntries, 3);
+    ASSERT_EQ(stats.userIndex.lengths.minLength, 1);
+    ASSERT_EQ(stats.userIndex.lengths.maxLength, 2);
+    ASSERT_EQ(stats.userIndex.lengths.lengthsLog2[0], 1);
+    ASSERT_EQ(stats.userIndex.lengths.lengthsLog2[1], 1);
+    ASSERT_GE(stats.userIndex.reservedEntries, stats.userIndex.usedEntries);
+    ASSERT_EQ(stats.userIndex.reservedUnusedBytes,
+              (stats.userIndex.reservedEntries - stats.userIndex.usedEntries) * sizeof(uint64_t));
+    ASSERT_GE(stats.userIndex.table.buckets, stats.userIndex.table.keys);
+    ASSERT_GE(stats.userIndex.table.maxChainLength, 1);
+
+    // securities stay interned once drained, only the SecId1 list still holds orders
+    ASSERT_EQ(stats.securityIndex.table.keys, 2);
+    ASSERT_EQ(stats.securityIndex.usedEntries, 3);
+    ASSERT_EQ(stats.securityIndex.lengths.maxLength, 3);
+    ASSERT_EQ(stats.securityIndex.lengths.p50Length, 3);
+}
+
+// Metrics: memory accounting splits the footprint into storage, index and string payload bytes
+TEST_F(OrderCacheTest, Metrics_MemoryUsage_AccountsStorageIndexesAndPayloads)
+{
+    CHECK_GLOBAL_FAILURE_FLAG();
+
+    const std::string longUser(64, 'u');
+    cache.addOrder(Order{"OrdId1", "SecId1", "Buy", 100, "User1", "Company1"});
+    cache.addOrder(Order{"OrdId2", "SecId1", "Sell", 200, longUser, "Company2"});
+    // the user index holds nothing until the first user cancel builds it
+    ASSERT_EQ(cache.memoryUsage().userIndex.total(), 0);
+    cache.cancelOrdersForUser("User9");
+
+    const auto usage{cache.memoryUsage()};
+    ASSERT_GE(usage.storage.slotHandles,
+              cache.stats().storageCapacity * sizeof(order_cache::storage::SlotHandle));
+    ASSERT_GE(usage.storage.coldSlots, cache.stats().storageCapacity * sizeof(order_cache::storage::ColdOrder));
+    ASSERT_GT(usage.storage.symbols, 0);
+    // only the long user name leaves the small string buffer
+    ASSERT_EQ(usage.storage.stringPayloads, order_cache::memory::heapBlockBytes(longUser.size() + 1));
+    ASSERT_EQ(usage.storage.aliveBitmap,
+              order_cache::memory::heapBlockBytes((cache.stats().storageSlots + 63) / 64 * sizeof(uint64_t)));
+    ASSERT_GT(usage.userIndex.slots, 0);
+    ASSERT_GT(usage.userIndex.keyStrings, 0);
+    // one security segment holding one chunk
+    ASSERT_GE(usage.storage.segments,
+              order_cache::storage::SecuritySegment::CHUNK_ENTRIES * sizeof(order_cache::storage::HotOrder));
+    ASSERT_EQ(usage.total(), usage.storage.total() + usage.userIndex.total() + usage.qtyIndex);
+
+    cache.cancelOrdersForSecIdWithMinimumQty("SecId1", 1);
+    const auto empty{cache.memoryUsage()};
+    ASSERT_EQ(empty.userIndex.keyStrings, 0);
+    ASSERT_EQ(empty.storage.segments, usage.storage.segments);
+    ASSERT_EQ(empty.storage.slotHandles, usage.storage.slotHandles);
+    ASSERT_EQ(empty.storage.symbols, usage.storage.symbols);
+}
+
+// Allocations: a reserved and prefaulted cache neither grows its arrays nor rehashes on the first adds
+TEST_F(OrderCacheTest, Allocations_ReservePrefault_SizesStructuresUpFront)
+{
+    CHECK_GLOBAL_FAILURE_FLAG();
+
+    constexpr std::size_t ORDERS{20000};
+    cache.reserve(ORDERS, NUM_SECURITIES, NUM_USERS, NUM_COMPANIES);
+    cache.prefault();
+    const auto stats{cache.stats()};
+    ASSERT_GE(stats.storageCapacity, ORDERS);
+    // the ring is sized and written, the window stays empty until the first add
+    ASSERT_EQ(stats.storageSlots, 0);
+    const auto coldSlots{cache.memoryUsage().storage.coldSlots};
+    ASSERT_GE(coldSlots, stats.storageCapacity * sizeof(order_cache::storage::ColdOrder));
+    // the user index takes the reserved size when the first user cancel builds it
+    ASSERT_EQ(stats.userIndex.table.buckets, 0);
+
+    for (const auto& order : generateOrders(ORDERS))
+    {
+        cache.addOrder(order);
+    }
+    ASSERT_EQ(cache.stats().storageCapacity, stats.storageCapacity);
+    ASSERT_EQ(cache.memoryUsage().storage.coldSlots, coldSlots);
+    cache.cancelOrdersForUser("User" + std::to_string(NUM_USERS));
+    ASSERT_GE(cache.stats().userIndex.table.buckets, NUM_USERS);
+    ASSERT_EQ(cache.getAllOrders().size(), ORDERS);
+}
+
+// Metrics: compact() returns what a mass cancellation left behind and keeps the cache usable
+TEST_F(OrderCacheTest, Metrics_Compact_ReleasesDeadSlotsAndIndexCapacity)
+{
+    CHECK_GLOBAL_FAILURE_FLAG();
+
+    const std::string algoUser(64, 'a');
+    cache.reserve(20000, 10, 101, 1);
+    for (int i = 0; i < 20000; ++i)
+    {
+        const auto& user{i >= 19800 ? users[i % NUM_USERS] : algoUser};
+        cache.addOrder(Order{"OrdId" + std::to_string(i), secIds[i % 10], sides[i % 2], 100, user, "Comp1"});
+    }
+    cache.cancelOrdersForUser(algoUser);
+    const auto before{cache.memoryUsage()};
+    const auto matching{cache.getMatchingSizeForSecurity(secIds[0])};
+    const auto orders{cache.getAllOrders()};
+
+    cache.compact();
+    const auto after{cache.memoryUsage()};
+    ASSERT_LT(after.total(), before.total() / 4);
+    ASSERT_EQ(after.storage.stringPayloads, 0);
+    ASSERT_LT(after.storage.coldSlots, before.storage.coldSlots);
+    ASSERT_LT(after.storage.segments, before.storage.segments);
+    // the window now starts at the word of the oldest live id
+    ASSERT_EQ(cache.stats().storageSlots, 20000 - 19800 / 64 * 64);
+
+    ASSERT_EQ(cache.getMatchingSizeForSecurity(secIds[0]), matching);
+    const auto compacted{cache.getAllOrders()};
+    ASSERT_EQ(compacted.size(), orders.size());
+    for (std::size_t i = 0; i < orders.size(); ++i)
+    {
+        ASSERT_EQ(compacted[i].orderId(), orders[i].orderId());
+        ASSERT_EQ(compacted[i].user(), orders[i].user());
+    }
+    cache.addOrder(Order{"OrdId5", secIds[0], "Sell", 100, algoUser, "Comp2"});
+    cache.cancelOrder("OrdId19800");
+    ASSERT_EQ(cache.getAllOrders().size(), orders.size());
+}
+
+// Metrics: trace rings keep the newest spans and export them as Chrome trace events
+TEST_F(OrderCacheTest, Metrics_Trace_RingKeepsNewestSpansAndExportsChromeJson)
+{
+    CHECK_GLOBAL_FAILURE_FLAG();
+
+    order_cache::trace::TraceBuffer buffer{7, 3}; // rounded up to 4 spans
+    ASSERT_EQ(buffer.capacity(), 4);
+    const char* names[]{"a", "b", "c", "d", "e", "f"};
+    for (uint64_t i = 0; i < 6; ++i)
+    {
+        buffer.record(names[i], 100 * i, 100 * i + 50);
+    }
+    ASSERT_EQ(buffer.recorded(), 6);
+    ASSERT_EQ(buffer.size(), 4);
+    ASSERT_STREQ(buffer[0].name, "c");
+    ASSERT_STREQ(buffer[3].name, "f");
+
+    std::ostringstream json;
+    order_cache::trace::writeChromeTrace(json, {&buffer});
+    const auto text{json.str()};
+    ASSERT_EQ(text.find("\"name\":\"b\""), std::string::npos);
+    ASSERT_NE(text.find("{\"name\":\"c\",\"cat\":\"order_cache\",\"ph\":\"X\",\"pid\":1,\"tid\":7,\"ts\":0.000"),
+              std::string::npos);
+    size_t events{0};
+    for (auto pos{text.find("\"ph\":\"X\"")}; pos != std::string::npos; pos = text.find("\"ph\":\"X\"", pos + 1))
+    {
+        ++events;
+    }
+    ASSERT_EQ(events, 4);
+
+    auto& registry{order_cache::trace::TraceRegistry::instance()};
+    const auto before{registry.recorded()};
+    {
+        order_cache::trace::ScopedTrace<true> outer{"outer"};
+        order_cache::trace::ScopedTrace<true> inner{"inner"};
+    }
+    ASSERT_EQ(registry.recorded(), before + 2);
+}
+
+// Allocations: matching queries on a warmed up cache never touch the heap
+TEST_F(OrderCacheTest, Allocations_GetMatchingSizeForSecurity_ZeroInSteadyState)
+{
+    CHECK_GLOBAL_FAILURE_FLAG();
+
+    for (const auto& order : generateOrders(20000))
+    {
+        cache.addOrder(order);
+    }
+    for (const auto& secId : secIds)
+    {
+        cache.getMatchingSizeForSecurity(secId);
+    }
+
+    order_cache::alloc::AllocationScope scope;
+    uint64_t total{0};
+    for (const auto& secId : secIds)
+    {
+        total += cache.getMatchingSizeForSecurity(secId);
+    }
+    total += cache.getMatchingSizeForSecurity("UnknownSecurity");
+    const auto allocations{scope.allocations()};
+
+    ASSERT_GT(total, 0);
+    ASSERT_EQ(allocations, 0);
+}
+
+// Allocations: single order cancellation never allocates, draining a user only erases its index key
+TEST_F(OrderCacheTest, Allocations_CancelOrder_ZeroInSteadyState)
+{
+    CHECK_GLOBAL_FAILURE_FLAG();
+
+    const auto orders{generateOrders(20000)};
+    for (const auto& order : orders)
+    {
+        cache.addOrder(order);
+    }
+    std::vector<std::string> orderIds;
+    orderIds.reserve(orders.size() + 1);
+    for (const auto& order : orders)
+    {
+        orderIds.emplace_back(order.orderId());
+    }
+    orderIds.emplace_back("OrdId99999999");
+    // the user index is built lazily, an unknown user builds it so every cancel unlinks from a user list
+    cache.cancelOrdersForUser("UserUnknown");
+    ASSERT_EQ(cache.stats().userIndex.table.keys, users.size());
+
+    order_cache::alloc::AllocationScope scope;
+    for (const auto& orderId : orderIds)
+    {
+        cache.cancelOrder(orderId);
+    }
+    const auto delta{scope.delta()};
+
+    ASSERT_EQ(delta.allocations, 0);
+    ASSERT_EQ(cache.stats().userIndex.table.keys, 0);
+    ASSERT_TRUE(cache.getAllOrders().empty());
+}
+
+// Allocations: the user index owns its keys, so they survive the storage growing under them, and cancels look
+// them up by view without copying a key
+TEST_F(OrderCacheTest, Allocations_CancelOrder_UserIndexOwnsKeysAndLooksUpByView)
+{
+    CHECK_GLOBAL_FAILURE_FLAG();
+
+    // names past the small string buffer, a key copy on lookup would allocate
+    const std::string prefix(32, 'u');
+    const auto add{
+        [&](int first, int last)
+        {
+            for (int i = first; i < last; ++i)
+            {
+                cache.addOrder(Order{"OrdId" + std::to_string(i * 7), "SecId1", i % 2 == 0 ? "Buy" : "Sell", 100,
+                    prefix + std::to_string(i % 50), "Company1"});
+            }
+        }
+    };
+    add(0, 100);
+    cache.cancelOrdersForUser("UserUnknown");
+    // the slot arrays reallocate and move every stored user string the keys were copied from
+    add(100, 20000);
+
+    std::vector<std::string> orderIds;
+    for (int i = 0; i < 20000; ++i)
+    {
+        orderIds.emplace_back("OrdId" + std::to_string(i * 7));
+    }
+
+    order_cache::alloc::AllocationScope scope;
+    for (const auto& orderId : orderIds)
+    {
+        cache.cancelOrder(orderId);
+    }
+    const auto delta{scope.delta()};
+
+    ASSERT_EQ(delta.allocations, 0);
+    ASSERT_EQ(cache.stats().userIndex.table.keys, 0);
+    ASSERT_TRUE(cache.getAllOrders().empty());
+}
+
+// Allocations: addOrder is free for known users and securities and bounded when it creates index keys
+TEST_F(OrderCacheTest, Allocations_AddOrder_BoundedPerCall)
+{
+    CHECK_GLOBAL_FAILURE_FLAG();
+
+    // reserved for both batches, so no array or hash table grows: short keys sit inline in the map slots
+    // and user lists are linked through the order slots, a new security or company symbol allocates its
+    // owned name, a new security segment its chunk list and first chunk, a new company book may grow the
+    // book table of the segment
+    cache.reserve(40000, NUM_SECURITIES, NUM_USERS, NUM_COMPANIES);
+    constexpr uint64_t NEW_KEYS_ALLOCATION_BUDGET{2 * 1 + 2 + 1};
+    // the user index is built lazily, an unknown user builds it so every add links into a user list
+    cache.cancelOrdersForUser("UserUnknown");
+
+    // the second batch trades the same (security, company) pairs as the first one
+    auto orders{generateOrders(20000)};
+    auto more{generateOrders(20000)};
+    for (size_t i = 0; i < more.size(); ++i)
+    {
+        const auto& o{more[i]};
+        more[i] = Order{"OrdId" + std::to_string(20000 + i), orders[i].securityId(), o.side(), o.qty(), o.user(),
+            orders[i].company()};
+    }
+
+    uint64_t maxAllocations{0};
+    for (auto& order : orders)
+    {
+        order_cache::alloc::AllocationScope scope;
+        cache.addOrder(std::move(order));
+        maxAllocations = std::max(maxAllocations, scope.allocations());
+    }
+    ASSERT_LE(maxAllocations, NEW_KEYS_ALLOCATION_BUDGET);
+    ASSERT_EQ(cache.stats().userIndex.table.keys, users.size());
+
+    // every user, security and company book now exists, further adds do not allocate at all
+    order_cache::alloc::AllocationScope scope;
+    for (auto& order : more)
+    {
+        cache.addOrder(std::move(order));
+    }
+    const auto allocations{scope.allocations()};
+
+    ASSERT_EQ(allocations, 0);
+    ASSERT_EQ(cache.getAllOrders().size(), 40000);
+}
+
+// Allocations: once the quantity index is built, adds and cancels churning through new quantities reuse the
+// nodes of drained levels
+TEST_F(OrderCacheTest, Allocations_QtyIndex_AddAndCancelZeroInSteadyState)
+{
+    CHECK_GLOBAL_FAILURE_FLAG();
+
+    constexpr std::size_t LIVE{10000};
+    // every order a quantity of its own, so each add creates a level and each cancel erases one; an order
+    // replaces the one cancelled with it in the same security and company, the segments keep their size
+    auto orders{generateOrders(4 * LIVE)};
+    std::vector<std::string> orderIds;
+    orderIds.reserve(orders.size());
+    for (std::size_t i = 0; i < orders.size(); ++i)
+    {
+        const auto& o{orders[i]};
+        const auto& replaced{i < LIVE ? o : orders[i - LIVE]};
+        orders[i] = Order{o.orderId(), replaced.securityId(), o.side(), static_cast<unsigned int>(i + 1), o.user(),
+            replaced.company()};
+        orderIds.emplace_back(o.orderId());
+    }
+    for (std::size_t i = 0; i < LIVE; ++i)
+    {
+        cache.addOrder(std::move(orders[i]));
+    }
+    // a range above every quantity builds the index and cancels nothing
+    cache.cancelOrders(OrderCache::CancelFilter{secIds[0], "", 4 * LIVE + 1});
+    ASSERT_EQ(cache.stats().qtyLevels, LIVE);
+
+    // warm up the pool, the segments and the id window at the live count
+    const auto churn{
+        [&](std::size_t first, std::size_t last)
+        {
+            for (std::size_t i = first; i < last; ++i)
+            {
+                cache.addOrder(std::move(orders[i]));
+                cache.cancelOrder(orderIds[i - LIVE]);
+            }
+        }
+    };
+    churn(LIVE, 2 * LIVE);
+
+    order_cache::alloc::AllocationScope scope;
+    churn(2 * LIVE, 4 * LIVE);
+    const auto allocations{scope.allocations()};
+
+    ASSERT_EQ(allocations, 0);
+    ASSERT_EQ(cache.stats().qtyLevels, LIVE);
+    ASSERT_EQ(cache.getAllOrders().size(), LIVE);
+}
+
+// Performance: Add and match 1,000 orders
+TEST_F(OrderCacheTest, Performance_SmallDataset_1KOrders)
+{
+    CHECK_GLOBAL_FAILURE_FLAG();
+
+    unsigned int NUM_ORDERS = 1000;
+    std::vector<Order> orders = generateOrders(NUM_ORDERS);
+    auto start = std::chrono::high_resolution_clock::now();
+
+    // Add orders to the cache
+    for (int i = 0; i < orders.size(); i++)
+    {
+        cache.addOrder(orders[i]);
+    }
+
+    // Get matching size for every security and measure the time it takes
+    for (const auto& secId : secIds)
+    {
+        cache.getMatchingSizeForSecurity(secId);
+    }
+    auto end = std::chrono::high_resolution_clock::now();
+    auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(end - start).count();
+
+    double ncu = duration / benchmark_time; // Calculate the NCU based on benchmark
+
+    // Display the result
+    std::cout << BLUE_COLOR << "[     INFO ] Matched " << NUM_ORDERS << " orders in " << ncu << " NCUs (" << duration <<
+        "ms)" << RESET_COLOR << std::endl;
+    ASSERT_LE(ncu, 1500);
+}
+
+// Performance: Add and match 5,000 orders
+TEST_F(OrderCacheTest, Performance_SmallDataset_5KOrders)
+{
+    CHECK_GLOBAL_FAILURE_FLAG();
+
+    unsigned int NUM_ORDERS = 5000;
+    std::vector<Order> orders = generateOrders(NUM_ORDERS);
+    auto start = std::chrono::high_resolution_clock::now();
+
+    // Add orders to the cache
+    for (int i = 0; i < orders.size(); i++)
+    {
+        cache.addOrder(orders[i]);
+    }
+
+    // Get matching size for every security and measure the time it takes
+    for (const auto& secId : secIds)
+    {
+        cache.getMatchingSizeForSecurity(secId);
+    }
+    auto end = std::chrono::high_resolution_clock::now();
+    auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(end - start).count();
+
+    double ncu = duration / benchmark_time; // Calculate the NCU based on benchmark
+
+    // Display the result
+    std::cout << BLUE_COLOR << "[     INFO ] Matched " << NUM_ORDERS << " orders in " << ncu << " NCUs (" << duration <<
+        "ms)" << RESET_COLOR << std::endl;
+    ASSERT_LE(ncu, 1500);
+}
+
+// Performance: Add and match 10,000 orders
+TEST_F(OrderCacheTest, Performance_MediumDataset_10KOrders)
+{
+    CHECK_GLOBAL_FAILURE_FLAG();
+
+    unsigned int NUM_ORDERS = 10000;
+    std::vector<Order> orders = generateOrders(NUM_ORDERS);
+    auto start = std::chrono::high_resolution_clock::now();
+
+    // Add orders to the cache
+    for (int i = 0; i < orders.size(); i++)
+    {
+        cache.addOrder(orders[i]);
+    }
+
+    // Get matching size for every security and measure the time it takes
+    for (const auto& secId : secIds)
+    {
+        cache.getMatchingSizeForSecurity(secId);
+    }
+    auto end = std::chrono::high_resolution_clock::now();
+    auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(end - start).count();
+
+    double ncu = duration / benchmark_time; // Calculate the NCU based on benchmark
+
+    // Display the result
+    std::cout << BLUE_COLOR << "[     INFO ] Matched " << NUM_ORDERS << " orders in " << ncu << " NCUs (" << duration <<
+        "ms)" << RESET_COLOR << std::endl;
+    ASSERT_LE(ncu, 1500);
+}
+
+// Performance: Add and match 50,000 orders
+TEST_F(OrderCacheTest, Performance_MediumDataset_50KOrders)
+{
+    CHECK_GLOBAL_FAILURE_FLAG();
+
+    unsigned int NUM_ORDERS = 50000;
+    std::vector<Order> orders = generateOrders(NUM_ORDERS);
+    auto start = std::chrono::high_resolution_clock::now();
+
+    // Add orders to the cache
+    for (int i = 0; i < orders.size(); i++)
+    {
+        cache.addOrder(orders[i]);
+    }
+
+    // Get matching size for every security and measure the time it takes
+    for (const auto& secId : secIds)
+    {
+        cache.getMatchingSizeForSecurity(secId);
+    }
+    auto end = std::chrono::high_resolution_clock::now();
+    auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(end - start).count();
+
+    double ncu = duration / benchmark_time; // Calculate the NCU based on benchmark
+
+    // Display the result
+    std::cout << BLUE_COLOR << "[     INFO ] Matched " << NUM_ORDERS << " orders in " << ncu << " NCUs (" << duration <<
+        "ms)" << RESET_COLOR << std::endl;
+    ASSERT_LE(ncu, 1500);
+}
+
+// Performance: Add and match 100,000 orders
+TEST_F(OrderCacheTest, Performance_LargeDataset_100KOrders)
+{
+    CHECK_GLOBAL_FAILURE_FLAG();
+
+    unsigned int NUM_ORDERS = 100000;
+    std::vector<Order> orders = generateOrders(NUM_ORDERS);
+    auto start = std::chrono::high_resolution_clock::now();
+
+    // Add orders to the cache
+    for (int i = 0; i < orders.size(); i++)
+    {
+        cache.addOrder(orders[i]);
+    }
+
+    // Get matching size for every security and measure the time it takes
+    for (const auto& secId : secIds)
+    {
+        cache.getMatchingSizeForSecurity(secId);
+    }
+    auto end = std::chrono::high_resolution_clock::now();
+    auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(end - start).count();
+
+    double ncu = duration / benchmark_time; // Calculate the NCU based on benchmark
+
+    // Display the result
+    std::cout << BLUE_COLOR << "[     INFO ] Matched " << NUM_ORDERS << " orders in " << ncu << " NCUs (" << duration <<
+        "ms)" << RESET_COLOR << std::endl;
+    ASSERT_LE(ncu, 1500);
+}
+
+// Performance: Add and match 500,000 orders
+TEST_F(OrderCacheTest, Performance_LargeDataset_500KOrders)
+{
+    CHECK_GLOBAL_FAILURE_FLAG();
+
+    unsigned int NUM_ORDERS = 500000;
+    std::vector<Order> orders = generateOrders(NUM_ORDERS);
+    auto start = std::chrono::high_resolution_clock::now();
+
+    // Add orders to the cache
+    for (int i = 0; i < orders.size(); i++)
+    {
+        cache.addOrder(orders[i]);
+    }
+
+    // Get matching size for every security and measure the time it takes
+    for (const auto& secId : secIds)
+    {
+        cache.getMatchingSizeForSecurity(secId);
+    }
+    auto end = std::chrono::high_resolution_clock::now();
+    auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(end - start).count();
+
+    double ncu = duration / benchmark_time; // Calculate the NCU based on benchmark
+
+    // Display the result
+    std::cout << BLUE_COLOR << "[     INFO ] Matched " << NUM_ORDERS << " orders in " << ncu << " NCUs (" << duration <<
+        "ms)" << RESET_COLOR << std::endl;
+    ASSERT_LE(ncu, 1500);
+}
+
+// Performance: Add and match 1,000,000 orders
+TEST_F(OrderCacheTest, Performance_VeryLargeDataset_1MOrders)
+{
+    CHECK_GLOBAL_FAILURE_FLAG();
+
+    unsigned int NUM_ORDERS = 1000000;
+    std::vector<Order> orders = generateOrders(NUM_ORDERS);
+
+
+    auto first{orders.front()};
+    auto last{orders.back()};
+
+
+    auto start = std::chrono::high_resolution_clock::now();
+
+    // Add orders to the cache
+    for (int i = 0; i < orders.size(); i++)
+    {
+        cache.addOrder(orders[i]);
+    }
+
+    // Get matching size for every security and measure the time it takes
+    for (const auto& secId : secIds)
+    {
+        cache.getMatchingSizeForSecurity(secId);
     }
     auto end = std::chrono::high_resolution_clock::now();
     auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(end - start).count();
@@ -1301,6 +2924,35 @@ TEST_F(OrderCacheTest, Performance_VeryLargeDataset_1MOrders)
     ASSERT_LE(ncu, 1500);
 }
 
+// Performance: Add and match 1,000,000 orders drawn from a skewed (Zipf) flow
+TEST_F(OrderCacheTest, Performance_SkewedDataset_1MOrders)
+{
+    CHECK_GLOBAL_FAILURE_FLAG();
+
+    unsigned int NUM_ORDERS = 1000000;
+    order_cache::workload::OrderGenerator generator{skewedConfig()};
+    std::vector<Order> orders = generator.generate(NUM_ORDERS);
+    auto start = std::chrono::high_resolution_clock::now();
+
+    for (const auto& order : orders)
+    {
+        cache.addOrder(order);
+    }
+
+    for (const auto& secId : generator.securities())
+    {
+        cache.getMatchingSizeForSecurity(secId);
+    }
+    auto end = std::chrono::high_resolution_clock::now();
+    auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(end - start).count();
+
+    double ncu = duration / benchmark_time;
+
+    std::cout << BLUE_COLOR << "[     INFO ] Matched " << NUM_ORDERS << " skewed orders in " << ncu << " NCUs (" <<
+        duration << "ms)" << RESET_COLOR << std::endl;
+    ASSERT_LE(ncu, 1500);
+}
+
 int main(int argc, char** argv)
 {
     ::testing::InitGoogleTest(&argc, argv);
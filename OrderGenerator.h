@@ -0,0 +1,200 @@
+#pragma once
+
+#include "Order.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace order_cache::workload
+{
+    using Random = std::mt19937_64;
+
+    // uniform double in [0, 1) built from the raw engine bits, unlike std::uniform_real_distribution
+    // the sequence is identical on every standard library for the same seed
+    [[nodiscard]] inline double uniformUnit(Random& gen) noexcept
+    {
+        return static_cast<double>(gen() >> 11) * 0x1.0p-53;
+    }
+
+    // Ranks in [0, n) with P(k) proportional to 1 / (k + 1)^exponent, exponent 0 is uniform
+    class ZipfDistribution final
+    {
+    public:
+        ZipfDistribution(std::size_t n, double exponent)
+        {
+            const auto size{std::max<std::size_t>(n, 1)};
+            m_cdf.reserve(size);
+            double sum{0};
+            for (std::size_t k = 0; k < size; ++k)
+            {
+                sum += 1.0 / std::pow(static_cast<double>(k + 1), exponent);
+                m_cdf.emplace_back(sum);
+            }
+            for (auto& value : m_cdf)
+            {
+                value /= sum;
+            }
+        }
+
+        [[nodiscard]] std::size_t operator()(Random& gen) const
+        {
+            const auto u{uniformUnit(gen)};
+            const auto it{std::upper_bound(m_cdf.begin(), m_cdf.end(), u)};
+            return std::min(static_cast<std::size_t>(it - m_cdf.begin()), m_cdf.size() - 1);
+        }
+
+        // probability mass of the `k` most popular ranks
+        [[nodiscard]] double headMass(std::size_t k) const noexcept
+        {
+            return k == 0 ? 0.0 : m_cdf[std::min(k, m_cdf.size()) - 1];
+        }
+
+        [[nodiscard]] std::size_t size() const noexcept { return m_cdf.size(); }
+
+    private:
+        std::vector<double> m_cdf;
+    };
+
+    struct DimensionConfig
+    {
+        unsigned int count{1};
+        double zipfExponent{0.0};
+    };
+
+    enum class QtyDistribution : uint32_t
+    {
+        UniformLots = 0, // lots uniform in [minLots, maxLots]
+        PowerLawLots, // small lots dominate, P(lots) ~ 1 / lots^qtyExponent
+    };
+
+    struct GeneratorConfig
+    {
+        DimensionConfig users{1'000, 0.0};
+        DimensionConfig companies{100, 0.0};
+        DimensionConfig securities{1'000, 0.0};
+
+        double buyRatio{0.5};
+
+        QtyDistribution qtyDistribution{QtyDistribution::UniformLots};
+        unsigned int minLots{1};
+        unsigned int maxLots{50};
+        unsigned int lotSize{100};
+        double qtyExponent{1.5};
+
+        // companies are either drawn per order or fixed per user, the latter matches real membership
+        bool userBelongsToOneCompany{false};
+
+        // consecutive order ids differ by orderIdStride, anything above 1 gives a sparse id space
+        uint64_t firstOrderId{0};
+        uint64_t orderIdStride{1};
+        uint64_t seed{12345};
+    };
+
+    // Deterministic order flow generator shared by the tests and the benchmarks. Names follow the
+    // "User<n>", "Comp<n>", "SecId<n>" scheme, rank 0 is the most popular key of every dimension.
+    class OrderGenerator final
+    {
+    public:
+        explicit OrderGenerator(const GeneratorConfig& config)
+            : m_config(config),
+              m_users(_makeNames("User", config.users.count)),
+              m_companies(_makeNames("Comp", config.companies.count)),
+              m_securities(_makeNames("SecId", config.securities.count)),
+              m_userDist(m_users.size(), config.users.zipfExponent),
+              m_companyDist(m_companies.size(), config.companies.zipfExponent),
+              m_securityDist(m_securities.size(), config.securities.zipfExponent),
+              m_lotsDist(config.maxLots >= config.minLots ? config.maxLots - config.minLots + 1 : 1,
+                         config.qtyDistribution == QtyDistribution::PowerLawLots ? config.qtyExponent : 0.0),
+              m_gen(config.seed),
+              m_nextOrderId(config.firstOrderId)
+        {
+            if (config.userBelongsToOneCompany)
+            {
+                m_userCompany.reserve(m_users.size());
+                for (std::size_t i = 0; i < m_users.size(); ++i)
+                {
+                    m_userCompany.emplace_back(m_companyDist(m_gen));
+                }
+            }
+        }
+
+        [[nodiscard]] Order next()
+        {
+            const auto user{m_userDist(m_gen)};
+            const auto company{m_userCompany.empty() ? m_companyDist(m_gen) : m_userCompany[user]};
+            const auto security{m_securityDist(m_gen)};
+            const auto isBuy{uniformUnit(m_gen) < m_config.buyRatio};
+            return Order{
+                _nextOrderIdString(),
+                m_securities[security],
+                std::string{isBuy ? BUY_SIDE : SELL_SIDE},
+                nextQty(),
+                m_users[user],
+                m_companies[company]
+            };
+        }
+
+        [[nodiscard]] std::vector<Order> generate(std::size_t numOrders)
+        {
+            std::vector<Order> orders;
+            orders.reserve(numOrders);
+            for (std::size_t i = 0; i < numOrders; ++i)
+            {
+                orders.emplace_back(next());
+            }
+            return orders;
+        }
+
+        [[nodiscard]] unsigned int nextQty()
+        {
+            const auto lots{m_config.minLots + static_cast<unsigned int>(m_lotsDist(m_gen))};
+            return lots * m_config.lotSize;
+        }
+
+        [[nodiscard]] const std::string& pickUser() { return m_users[m_userDist(m_gen)]; }
+        [[nodiscard]] const std::string& pickSecurity() { return m_securities[m_securityDist(m_gen)]; }
+
+        [[nodiscard]] const GeneratorConfig& config() const noexcept { return m_config; }
+        [[nodiscard]] const std::vector<std::string>& users() const noexcept { return m_users; }
+        [[nodiscard]] const std::vector<std::string>& companies() const noexcept { return m_companies; }
+        [[nodiscard]] const std::vector<std::string>& securities() const noexcept { return m_securities; }
+        [[nodiscard]] const ZipfDistribution& securityDistribution() const noexcept { return m_securityDist; }
+        [[nodiscard]] Random& random() noexcept { return m_gen; }
+        [[nodiscard]] uint64_t nextOrderId() const noexcept { return m_nextOrderId; }
+
+    private:
+        GeneratorConfig m_config;
+        std::vector<std::string> m_users;
+        std::vector<std::string> m_companies;
+        std::vector<std::string> m_securities;
+        ZipfDistribution m_userDist;
+        ZipfDistribution m_companyDist;
+        ZipfDistribution m_securityDist;
+        ZipfDistribution m_lotsDist;
+        std::vector<std::size_t> m_userCompany;
+        Random m_gen;
+        uint64_t m_nextOrderId;
+
+        [[nodiscard]] std::string _nextOrderIdString()
+        {
+            const auto id{m_nextOrderId};
+            m_nextOrderId += std::max<uint64_t>(m_config.orderIdStride, 1);
+            return std::string{ORDER_ID_PREFIX} + std::to_string(id);
+        }
+
+        [[nodiscard]] static std::vector<std::string> _makeNames(const char* prefix, unsigned int count)
+        {
+            std::vector<std::string> names;
+            names.reserve(std::max(count, 1u));
+            for (unsigned int i = 0; i < std::max(count, 1u); ++i)
+            {
+                names.emplace_back(prefix + std::to_string(i));
+            }
+            return names;
+        }
+    };
+}
@@ -1,77 +1,597 @@
 #pragma once
 
+#include "HugePageAllocator.h"
+#include "MemoryUsage.h"
 #include "Order.h"
+#include "SecuritySegment.h"
+#include "SymbolTable.h"
 
-#include <vector>
+#include <algorithm>
 #include <cstdint>
-#include <limits>
+#include <unordered_map>
+#include <vector>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
 
 namespace order_cache::storage
 {
+    // Where the hot fields of an order live: its security segment and the position inside it
+    struct SlotHandle
+    {
+        Symbol security{0};
+        uint32_t position{0};
+    };
+
+    static constexpr uint64_t NO_ORDER{~uint64_t{0}};
+
+    // Order indexes stay below the last 64 ids of the range, so the window end and the bitmap words walked up to
+    // it never wrap; NO_ORDER is among the ids left out.
+    static constexpr uint64_t INDEX_LIMIT{NO_ORDER & ~uint64_t{63}};
+
+    // Neighbours of an order in one of the lists threaded through the cold slots, by order index, NO_ORDER
+    // at either end. Indexes survive the window moving, the links stay valid when an order moves to the
+    // overflow map.
+    struct OrderLinks
+    {
+        uint64_t prev{NO_ORDER};
+        uint64_t next{NO_ORDER};
+    };
+
+    // Fields only needed by user and filtered cancels and export
+    struct ColdOrder
+    {
+        std::string orderId;
+        std::string user;
+        OrderLinks userLinks{}; // the list of the user
+        OrderLinks qtyLinks{}; // the list of the quantity level in the security side
+    };
+
+    // Id-indexed arrays are the randomly accessed ones, they may be backed by huge pages
+    template <typename T>
+    using SlotArray = std::vector<T, alloc::HugePageAllocator<T>>;
+
+    // Orders addressed by their numeric id. The hot fields are clustered by security in chunked segments,
+    // so a per-security scan reads one sequential stream; the id-indexed arrays only keep a slot handle and
+    // the cold strings. Securities and companies are interned, the original Order is rebuilt on export.
+    //
+    // The id-indexed arrays are a ring covering a sliding window of the id space, id i lives in slot
+    // i & mask. Ids grow through the day, so once the oldest words of the window are dead the window start
+    // moves past them without copying anything and their slots are reused by the next ids; the few long-lived
+    // orders left in sparse words at the front, and ids added below the window, live in a small overflow map.
+    // Memory follows the live id range rather than the highest id ever seen.
     class OrderIndexedStorage final
     {
     public:
-        explicit OrderIndexedStorage(std::size_t minSize = 0)
-        {
-            m_orders.resize(minSize, Order{"", "", "", 0, "", ""});
-            m_orderPositions.resize(minSize, INVALID_ORDER_POSITION);
-            m_aliveOrderIndexes.reserve(minSize);
-        }
+        OrderIndexedStorage() = default;
 
         OrderIndexedStorage(OrderIndexedStorage&&) = delete;
         OrderIndexedStorage& operator=(OrderIndexedStorage&&) = delete;
         OrderIndexedStorage(const OrderIndexedStorage&) = delete;
         OrderIndexedStorage& operator=(const OrderIndexedStorage&) = delete;
 
+        // expects a validated order, the side is either Buy or Sell, and an index below INDEX_LIMIT
         void addOrder(Order&& order, uint64_t index)
         {
-            if (index >= m_orders.size())
+            SlotHandle* slot{nullptr};
+            ColdOrder* cold{nullptr};
+            if (m_liveWords == 0 && (m_liveOrders == 0 || index >= m_end))
+            {
+                // every slot is dead, the window restarts at the word of this id instead of spanning the gap; the
+                // overflow orders stay below it unless the map is empty
+                m_start = index & ~(WORD_BITS - 1);
+                m_end = m_start;
+            }
+            if (index < _windowStart())
+            {
+                auto& straggler{m_overflow[index]};
+                slot = &straggler.slot;
+                cold = &straggler.cold;
+            }
+            else
             {
-                m_orders.resize(index + 1, Order{"", "", "", 0, "", ""});
-                m_orderPositions.resize(index + 1, INVALID_ORDER_POSITION);
+                if (index >= m_end)
+                {
+                    _extendWindow(index + 1);
+                }
+                const auto local{index & m_mask};
+                auto& word{m_alive[local / WORD_BITS]};
+                m_liveWords += word == 0 ? 1 : 0;
+                word |= _bit(local);
+                slot = &m_slots[local];
+                cold = &m_cold[local];
             }
 
-            m_orderPositions[index] = static_cast<uint64_t>(m_aliveOrderIndexes.size());
-            m_aliveOrderIndexes.emplace_back(index);
-            m_orders[index] = std::move(order);
+            const auto security{m_securities.intern(order.securityIdSv())};
+            if (security >= m_segments.size())
+            {
+                m_segments.resize(security + 1);
+            }
+            const auto company{m_companies.intern(order.companySv())};
+            if (company >= m_companySecurities.size())
+            {
+                m_companySecurities.resize(company + 1, NO_SYMBOL);
+            }
+            auto& segment{m_segments[security]};
+            const auto position{
+                segment.push(HotOrder{
+                    index,
+                    company,
+                    order.qty(),
+                    order.sideSv() == BUY_SIDE ? Side::Buy : Side::Sell
+                })
+            };
+            if (segment.book(company)->orders == 1)
+            {
+                _linkCompanySecurity(company, security);
+            }
+            *slot = SlotHandle{security, position};
+            cold->orderId.assign(order.orderIdSv());
+            cold->user.assign(order.userSv());
+            ++m_liveOrders;
         }
 
         [[nodiscard]] bool hasOrder(uint64_t index) const noexcept
         {
-            return index < m_orderPositions.size() && m_orderPositions[index] != INVALID_ORDER_POSITION;
+            if (index < _windowStart())
+            {
+                return m_overflow.find(index) != m_overflow.end();
+            }
+            return index < m_end && (_word(index) & _bit(index)) != 0;
+        }
+
+        [[nodiscard]] Symbol security(uint64_t index) const noexcept { return _slot(index).security; }
+
+        [[nodiscard]] const HotOrder& hot(uint64_t index) const noexcept
+        {
+            const auto& slot{_slot(index)};
+            return m_segments[slot.security][slot.position];
+        }
+
+        [[nodiscard]] const ColdOrder& cold(uint64_t index) const noexcept
+        {
+            return index < _windowStart() ? m_overflow.find(index)->second.cold : m_cold[index & m_mask];
+        }
+
+        // threaded through the cold slots by the user index, which keeps only the ends of each list
+        [[nodiscard]] OrderLinks& userLinks(uint64_t index) noexcept
+        {
+            return index < _windowStart() ? m_overflow.find(index)->second.cold.userLinks :
+                m_cold[index & m_mask].userLinks;
+        }
+
+        // threaded through the cold slots by the quantity index, which keeps only the ends of each level
+        [[nodiscard]] OrderLinks& qtyLinks(uint64_t index) noexcept
+        {
+            return index < _windowStart() ? m_overflow.find(index)->second.cold.qtyLinks :
+                m_cold[index & m_mask].qtyLinks;
         }
 
-        [[nodiscard]] const Order& getOrder(uint64_t index) const noexcept
+        [[nodiscard]] Order order(uint64_t index) const
         {
-            return m_orders[index];
+            const auto& hotOrder{hot(index)};
+            const auto& coldOrder{cold(index)};
+            return Order{
+                coldOrder.orderId,
+                std::string{m_securities.name(security(index))},
+                std::string{hotOrder.side == Side::Buy ? BUY_SIDE : SELL_SIDE},
+                hotOrder.qty,
+                coldOrder.user,
+                std::string{m_companies.name(hotOrder.company)}
+            };
         }
 
-        void cancelOrder(uint64_t index) noexcept
+        // allocates only when stragglers move to the overflow map
+        void cancelOrder(uint64_t index)
         {
-            const auto removePosition{m_orderPositions[index]};
-            const auto lastAliveIdx{m_aliveOrderIndexes.back()};
+            const auto slot{_slot(index)};
+            auto& segment{m_segments[slot.security]};
+            const auto company{segment[slot.position].company};
+            const auto moved{segment.remove(slot.position)};
+            _slot(moved).position = slot.position;
+            if (segment.book(company)->orders == 0)
+            {
+                _unlinkCompanySecurity(company, slot.security);
+            }
+
+            if (index < _windowStart())
+            {
+                m_overflow.erase(index);
+            }
+            else
+            {
+                auto& word{m_alive[(index & m_mask) / WORD_BITS]};
+                word &= ~_bit(index);
+                m_liveWords -= word == 0 ? 1 : 0;
+            }
+            --m_liveOrders;
+            _advanceWindow();
+        }
+
+        // sizes the ring for a window of `orders` ids and the symbol tables, without touching the memory
+        void reserve(std::size_t orders, std::size_t securities, std::size_t companies)
+        {
+            const auto ring{_ringFor(orders)};
+            m_slots.reserve(ring);
+            m_cold.reserve(ring);
+            m_alive.reserve(ring / WORD_BITS);
+            m_segments.reserve(securities);
+            m_securities.reserve(securities);
+            m_companies.reserve(companies);
+            m_companySecurities.reserve(companies);
+        }
+
+        // grows the ring over the whole reserved capacity, writing every page of the arrays once
+        void prefault()
+        {
+            if (m_slots.capacity() >= WORD_BITS)
+            {
+                // the largest power of two the reserved capacity holds
+                _growRing(std::size_t{1} << _highestBit(m_slots.capacity()));
+            }
+        }
+
+        // trims the dead words at both ends of the window, moves the live slots into a ring just large
+        // enough for it, which drops the strings of the dead slots, and shrinks every segment to its
+        // contents; the next adds allocate again
+        void compact()
+        {
+            while (m_start < m_end && _word(m_start) == 0)
+            {
+                m_start += WORD_BITS;
+            }
+            m_end = std::max(m_start, m_end);
+            while (m_end > m_start)
+            {
+                const auto last{(m_end - 1) & ~(WORD_BITS - 1)};
+                if (const auto bits{_word(last)}; bits != 0)
+                {
+                    m_end = last + _highestBit(bits) + 1;
+                    break;
+                }
+                m_end = last;
+            }
 
-            m_aliveOrderIndexes[removePosition] = lastAliveIdx;
-            m_orderPositions[lastAliveIdx] = removePosition;
-            m_aliveOrderIndexes.pop_back();
+            const auto ring{m_end == m_start ? 0 : _ringFor(static_cast<std::size_t>(m_end - m_start))};
+            SlotArray<SlotHandle> slots(ring);
+            SlotArray<ColdOrder> cold(ring);
+            SlotArray<uint64_t> alive(ring / WORD_BITS, 0);
+            for (auto word{m_start}; word < m_end; word += WORD_BITS)
+            {
+                const auto bits{_word(word)};
+                alive[(word & (ring - 1)) / WORD_BITS] = bits;
+                for (auto live{bits}; live != 0; live &= live - 1)
+                {
+                    const auto index{word + _lowestBit(live)};
+                    auto& target{cold[index & (ring - 1)]};
+                    slots[index & (ring - 1)] = m_slots[index & m_mask];
+                    target = std::move(m_cold[index & m_mask]);
+                    target.orderId.shrink_to_fit();
+                    target.user.shrink_to_fit();
+                }
+            }
+            m_slots = std::move(slots);
+            m_cold = std::move(cold);
+            m_alive = std::move(alive);
+            m_mask = ring == 0 ? 0 : ring - 1;
 
-            m_orderPositions[index] = INVALID_ORDER_POSITION;
+            m_overflow.rehash(0);
+            for (auto& segment : m_segments)
+            {
+                segment.shrinkToFit();
+            }
+        }
+
+        // live orders of one security, nullptr for an unknown security
+        [[nodiscard]] const SecuritySegment* segment(std::string_view securityId) const
+        {
+            const auto security{m_securities.find(securityId)};
+            return security.has_value() ? &m_segments[security.value()] : nullptr;
+        }
+
+        [[nodiscard]] const std::vector<SecuritySegment>& segments() const noexcept { return m_segments; }
+
+        // one of the securities `company` has live orders in, NO_SYMBOL when it has none; the company's book
+        // there links to the next one
+        [[nodiscard]] Symbol firstSecurityOf(Symbol company) const noexcept
+        {
+            return company < m_companySecurities.size() ? m_companySecurities[company] : NO_SYMBOL;
+        }
+
+        [[nodiscard]] const SymbolTable& securities() const noexcept { return m_securities; }
+
+        [[nodiscard]] const SymbolTable& companies() const noexcept { return m_companies; }
+
+        [[nodiscard]] std::size_t size() const noexcept { return m_liveOrders; }
+
+        // slots of the window, from its start up to the highest id added
+        [[nodiscard]] std::size_t slots() const noexcept { return static_cast<std::size_t>(m_end - m_start); }
+
+        [[nodiscard]] std::size_t capacity() const noexcept { return m_slots.capacity(); }
+
+        // first id held by the window, lower ids are in the overflow map
+        [[nodiscard]] uint64_t windowStart() const noexcept { return _windowStart(); }
+
+        [[nodiscard]] std::size_t overflowOrders() const noexcept { return m_overflow.size(); }
+
+        // visits the indexes of the live orders in order, empty words of the bitmap skip 64 slots at a time
+        template <typename F>
+        void forEachOrder(F&& f) const
+        {
+            if (!m_overflow.empty())
+            {
+                std::vector<uint64_t> stragglers;
+                stragglers.reserve(m_overflow.size());
+                for (const auto& [index, _] : m_overflow)
+                {
+                    stragglers.emplace_back(index);
+                }
+                std::sort(stragglers.begin(), stragglers.end());
+                for (const auto index : stragglers)
+                {
+                    f(index);
+                }
+            }
+            for (auto word{m_start}; word < m_end; word += WORD_BITS)
+            {
+                for (auto bits{_word(word)}; bits != 0; bits &= bits - 1)
+                {
+                    f(word + _lowestBit(bits));
+                }
+            }
+        }
+
+        // walks every slot for the string payloads, dead slots keep the strings of their last order
+        [[nodiscard]] memory::StorageMemory memoryUsage() const noexcept
+        {
+            memory::StorageMemory result;
+            result.slotHandles = memory::vectorHeapBytes(m_slots);
+            result.coldSlots = memory::vectorHeapBytes(m_cold);
+            for (const auto& cold : m_cold)
+            {
+                result.stringPayloads += memory::stringHeapBytes(cold.orderId) + memory::stringHeapBytes(cold.user);
+            }
+            result.aliveBitmap = memory::vectorHeapBytes(m_alive);
+            result.segments = memory::vectorHeapBytes(m_segments);
+            for (const auto& segment : m_segments)
+            {
+                result.segments += segment.memoryUsage();
+                result.companyBooks += segment.bookMemory();
+            }
+            result.companyBooks += memory::vectorHeapBytes(m_companySecurities);
+
+            // an integer key keeps no cached hash, a node is the next pointer and the key/value pair
+            constexpr auto NODE_BYTES{sizeof(void*) + sizeof(OverflowMap::value_type)};
+            result.overflow = memory::heapBlockBytes(m_overflow.bucket_count() * sizeof(void*)) +
+                m_overflow.size() * memory::heapBlockBytes(NODE_BYTES);
+            for (const auto& [_, straggler] : m_overflow)
+            {
+                result.stringPayloads += memory::stringHeapBytes(straggler.cold.orderId) +
+                    memory::stringHeapBytes(straggler.cold.user);
+            }
+            result.symbols = m_securities.memoryUsage() + m_companies.memoryUsage();
+            return result;
         }
 
         [[nodiscard]] std::vector<Order> getAllOrders() const
         {
             std::vector<Order> result;
-            result.reserve(m_aliveOrderIndexes.size());
-            for (uint64_t idx : m_aliveOrderIndexes)
-                result.emplace_back(m_orders[idx]);
+            result.reserve(m_liveOrders);
+            forEachOrder([this, &result](uint64_t index) { result.emplace_back(order(index)); });
             return result;
         }
 
     private:
-        std::vector<Order> m_orders;
-        std::vector<uint64_t> m_orderPositions;
-        std::vector<uint64_t> m_aliveOrderIndexes;
+        static constexpr uint64_t WORD_BITS{64};
+        // live orders a word may hold and still count as sparse
+        static constexpr unsigned int MAX_STRAGGLERS_PER_WORD{8};
+        // sparse front words whose live orders one cancel may move to the overflow map
+        static constexpr unsigned int MAX_STRAGGLER_WORDS_PER_CALL{2};
+
+        struct OverflowOrder
+        {
+            SlotHandle slot;
+            ColdOrder cold;
+        };
+
+        using OverflowMap = std::unordered_map<uint64_t, OverflowOrder>;
+
+        // a ring of a power of two slots, id i of the window [m_start, m_end) lives in slot i & m_mask
+        SlotArray<SlotHandle> m_slots;
+        SlotArray<ColdOrder> m_cold;
+        SlotArray<uint64_t> m_alive; // bit i of word i / 64 is set while slot i holds a live order
+        uint64_t m_mask{0};
+        uint64_t m_start{0}; // a multiple of 64, so the words of the bitmap never straddle
+        uint64_t m_end{0}; // one past the highest id the window holds
+        OverflowMap m_overflow; // every id in it is below the window start
+        std::size_t m_liveOrders{0};
+        std::size_t m_liveWords{0}; // words of the bitmap with at least one live slot
+        std::vector<SecuritySegment> m_segments; // indexed by security symbol
+        // by company symbol, head of the list of securities the company has orders in, linked through its books
+        std::vector<Symbol> m_companySecurities;
+        SymbolTable m_securities;
+        SymbolTable m_companies;
+
+        [[nodiscard]] uint64_t _windowStart() const noexcept { return m_start; }
 
-        static constexpr uint64_t INVALID_ORDER_POSITION{std::numeric_limits<uint32_t>::max()};
+        // the bitmap word holding the id, the id must be in the window
+        [[nodiscard]] uint64_t _word(uint64_t index) const noexcept { return m_alive[(index & m_mask) / WORD_BITS]; }
+
+        [[nodiscard]] const SlotHandle& _slot(uint64_t index) const noexcept
+        {
+            return index < _windowStart() ? m_overflow.find(index)->second.slot : m_slots[index & m_mask];
+        }
+
+        [[nodiscard]] SlotHandle& _slot(uint64_t index) noexcept
+        {
+            return index < _windowStart() ? m_overflow.find(index)->second.slot : m_slots[index & m_mask];
+        }
+
+        void _linkCompanySecurity(Symbol company, Symbol security) noexcept
+        {
+            auto& head{m_companySecurities[company]};
+            m_segments[security].securityLinks(company) = SecurityLinks{NO_SYMBOL, head};
+            if (head != NO_SYMBOL)
+            {
+                m_segments[head].securityLinks(company).prev = security;
+            }
+            head = security;
+        }
+
+        void _unlinkCompanySecurity(Symbol company, Symbol security) noexcept
+        {
+            const auto links{m_segments[security].securityLinks(company)};
+            (links.prev == NO_SYMBOL ? m_companySecurities[company] :
+                m_segments[links.prev].securityLinks(company).next) = links.next;
+            if (links.next != NO_SYMBOL)
+            {
+                m_segments[links.next].securityLinks(company).prev = links.prev;
+            }
+        }
+
+        // retires the dead words at the front of the window; the live orders of at most
+        // MAX_STRAGGLER_WORDS_PER_CALL straggler words are moved to the overflow map per call. Retiring a word
+        // only moves the start, its slots are free for the ids past the end.
+        void _advanceWindow()
+        {
+            unsigned int stragglerWords{0};
+            while (m_start < m_end)
+            {
+                const auto bits{_word(m_start)};
+                if (bits != 0)
+                {
+                    if (stragglerWords == MAX_STRAGGLER_WORDS_PER_CALL || !_isStragglerWord(bits))
+                    {
+                        break;
+                    }
+                    _moveToOverflow(m_start, bits);
+                    ++stragglerWords;
+                }
+                m_start += WORD_BITS;
+            }
+            m_end = std::max(m_start, m_end);
+        }
+
+        // a sparse front word followed by a sparse or dead word, holding at most a quarter of the live orders
+        // of an occupied word on average. A front word still draining in front of a dense run keeps its slots,
+        // its orders are about to be cancelled.
+        [[nodiscard]] bool _isStragglerWord(uint64_t bits) const noexcept
+        {
+            const auto next{m_start + WORD_BITS};
+            if (next >= m_end || _popCount(_word(next)) > MAX_STRAGGLERS_PER_WORD)
+            {
+                return false;
+            }
+            const uint64_t live{_popCount(bits)};
+            const uint64_t windowLive{m_liveOrders - m_overflow.size()};
+            return live <= MAX_STRAGGLERS_PER_WORD && live * m_liveWords * 4 < windowLive;
+        }
+
+        void _moveToOverflow(uint64_t word, uint64_t bits)
+        {
+            for (auto live{bits}; live != 0; live &= live - 1)
+            {
+                const auto index{word + _lowestBit(live)};
+                m_overflow.emplace(index, OverflowOrder{m_slots[index & m_mask], std::move(m_cold[index & m_mask])});
+            }
+            m_alive[(word & m_mask) / WORD_BITS] = 0;
+            --m_liveWords;
+        }
+
+        // moves the end of the window, growing the ring when the window no longer fits
+        void _extendWindow(uint64_t end)
+        {
+            const auto window{static_cast<std::size_t>(end - m_start)};
+            if (window > m_slots.size())
+            {
+                _growRing(_ringFor(window));
+            }
+            m_end = end;
+        }
+
+        // only the words whose slot changes with the wider mask move, into the new upper part of the ring
+        void _growRing(std::size_t ring)
+        {
+            const auto oldMask{m_mask};
+            const auto oldRing{m_slots.size()};
+            if (ring <= oldRing)
+            {
+                return;
+            }
+            m_slots.resize(ring);
+            m_cold.resize(ring);
+            m_alive.resize(ring / WORD_BITS, 0);
+            m_mask = ring - 1;
+            if (oldRing == 0)
+            {
+                return;
+            }
+            for (auto word{m_start}; word < m_end; word += WORD_BITS)
+            {
+                const auto from{word & oldMask};
+                const auto to{word & m_mask};
+                const auto bits{m_alive[from / WORD_BITS]};
+                if (from == to || bits == 0)
+                {
+                    continue;
+                }
+                for (auto live{bits}; live != 0; live &= live - 1)
+                {
+                    const auto bit{_lowestBit(live)};
+                    m_slots[to + bit] = m_slots[from + bit];
+                    m_cold[to + bit] = std::move(m_cold[from + bit]);
+                }
+                m_alive[to / WORD_BITS] = bits;
+                m_alive[from / WORD_BITS] = 0;
+            }
+        }
+
+        // the power of two ring, at least one bitmap word, holding a window of `slots` ids
+        [[nodiscard]] static std::size_t _ringFor(std::size_t slots) noexcept
+        {
+            std::size_t ring{WORD_BITS};
+            while (ring < slots)
+            {
+                ring *= 2;
+            }
+            return ring;
+        }
+
+        [[nodiscard]] static constexpr uint64_t _bit(uint64_t index) noexcept
+        {
+            return uint64_t{1} << (index % WORD_BITS);
+        }
+
+        [[nodiscard]] static unsigned int _lowestBit(uint64_t bits) noexcept
+        {
+#if defined(_MSC_VER)
+            unsigned long index{0};
+            _BitScanForward64(&index, bits);
+            return static_cast<unsigned int>(index);
+#else
+            return static_cast<unsigned int>(__builtin_ctzll(bits));
+#endif
+        }
+
+        [[nodiscard]] static unsigned int _highestBit(uint64_t bits) noexcept
+        {
+#if defined(_MSC_VER)
+            unsigned long index{0};
+            _BitScanReverse64(&index, bits);
+            return static_cast<unsigned int>(index);
+#else
+            return static_cast<unsigned int>(63 - __builtin_clzll(bits));
+#endif
+        }
+
+        [[nodiscard]] static unsigned int _popCount(uint64_t bits) noexcept
+        {
+#if defined(_MSC_VER)
+            return static_cast<unsigned int>(__popcnt64(bits));
+#else
+            return static_cast<unsigned int>(__builtin_popcountll(bits));
+#endif
+        }
     };
 }
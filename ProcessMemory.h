@@ -0,0 +1,87 @@
+#pragma once
+
+#include <cstddef>
+#include <fstream>
+#include <string>
+
+#if defined(__linux__)
+#include <sys/resource.h>
+#if defined(__GLIBC__)
+#include <malloc.h>
+#endif
+#endif
+
+namespace order_cache::bench
+{
+    struct ProcessMemory
+    {
+        std::size_t rssBytes{0};
+        std::size_t peakRssBytes{0}; // high water mark since start or since the last resetPeakRss()
+    };
+
+#if defined(__linux__)
+    namespace detail
+    {
+        // value of a "Key:   1234 kB" line of a /proc file, in bytes
+        [[nodiscard]] inline std::size_t procKibField(const char* path, const std::string& key)
+        {
+            std::ifstream file{path};
+            std::string line;
+            while (std::getline(file, line))
+            {
+                if (line.compare(0, key.size(), key) == 0 && line.size() > key.size() && line[key.size()] == ':')
+                {
+                    return std::stoull(line.substr(key.size() + 1)) * 1024;
+                }
+            }
+            return 0;
+        }
+    }
+
+    [[nodiscard]] inline ProcessMemory processMemory()
+    {
+        ProcessMemory result;
+        result.rssBytes = detail::procKibField("/proc/self/status", "VmRSS");
+        result.peakRssBytes = detail::procKibField("/proc/self/status", "VmHWM");
+        if (result.peakRssBytes == 0)
+        {
+            rusage usage{};
+            getrusage(RUSAGE_SELF, &usage);
+            result.peakRssBytes = static_cast<std::size_t>(usage.ru_maxrss) * 1024;
+        }
+        return result;
+    }
+
+    // Restarts the peak RSS at the current RSS, false when the kernel does not allow it
+    inline bool resetPeakRss()
+    {
+        std::ofstream clearRefs{"/proc/self/clear_refs"};
+        clearRefs << "5";
+        clearRefs.flush();
+        return clearRefs.good();
+    }
+
+    // Hands free heap pages back to the kernel so the next measurement starts from a clean RSS
+    inline void releaseFreeMemory()
+    {
+#if defined(__GLIBC__)
+        malloc_trim(0);
+#endif
+    }
+
+    [[nodiscard]] inline std::size_t availableMemoryBytes()
+    {
+        return detail::procKibField("/proc/meminfo", "MemAvailable");
+    }
+#else
+    [[nodiscard]] inline ProcessMemory processMemory() { return {}; }
+
+    inline bool resetPeakRss() { return false; }
+
+    inline void releaseFreeMemory()
+    {
+    }
+
+    [[nodiscard]] inline std::size_t availableMemoryBytes() { return 0; }
+#endif
+}
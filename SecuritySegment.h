@@ -0,0 +1,311 @@
+#pragma once
+
+#include "MemoryUsage.h"
+#include "SymbolTable.h"
+
+#include <cstdint>
+#include <memory>
+#include <utility>
+#include <vector>
+
+namespace order_cache::storage
+{
+    enum class Side : uint8_t
+    {
+        Buy = 0,
+        Sell,
+    };
+
+    static constexpr uint32_t NO_POSITION{~uint32_t{0}};
+
+    // Fields read by matching and cancellation, stored contiguously per security. The positions link the
+    // orders of one company within the segment, NO_POSITION at either end.
+    struct HotOrder
+    {
+        uint64_t orderIndex{0};
+        Symbol company{0};
+        uint32_t qty{0};
+        Side side{Side::Buy};
+        uint32_t prevInBook{NO_POSITION};
+        uint32_t nextInBook{NO_POSITION};
+    };
+
+    // Neighbours of a company book in the list of securities its company has orders in, by security symbol,
+    // NO_SYMBOL at either end
+    struct SecurityLinks
+    {
+        Symbol prev{NO_SYMBOL};
+        Symbol next{NO_SYMBOL};
+    };
+
+    // The resting orders of one company in one security: the ends of its list and the quantity per side
+    struct CompanyBook
+    {
+        Symbol company{0};
+        uint32_t head{NO_POSITION};
+        uint32_t tail{NO_POSITION};
+        uint32_t orders{0};
+        uint64_t buyQty{0};
+        uint64_t sellQty{0};
+        SecurityLinks securityLinks{};
+    };
+
+    // The live orders of one security packed into fixed size chunks, so a scan is a sequential stream
+    // and growing never moves entries. Positions are dense: removal moves the last entry into the hole,
+    // the caller updates the handle of the moved order.
+    //
+    // Every company trading the security has a book with its per side quantities, kept up to date on push
+    // and remove, so matching reads one entry per company instead of every order. The books sit in a small
+    // open addressing table on the company symbol and stay until shrinkToFit, drained or not.
+    class SecuritySegment final
+    {
+    public:
+        static constexpr uint32_t CHUNK_ENTRIES{128};
+
+        SecuritySegment() = default;
+        SecuritySegment(SecuritySegment&&) noexcept = default;
+        SecuritySegment& operator=(SecuritySegment&&) noexcept = default;
+        SecuritySegment(const SecuritySegment&) = delete;
+        SecuritySegment& operator=(const SecuritySegment&) = delete;
+
+        // position of the new entry, appended to the list of its company
+        uint32_t push(const HotOrder& order)
+        {
+            if (m_size == m_chunks.size() * CHUNK_ENTRIES)
+            {
+                m_chunks.emplace_back(std::make_unique<HotOrder[]>(CHUNK_ENTRIES));
+            }
+            const auto position{m_size++};
+            auto& book{_findOrAddBook(order.company)};
+            auto& entry{(*this)[position]};
+            entry = order;
+            entry.prevInBook = book.tail;
+            entry.nextInBook = NO_POSITION;
+            if (book.tail == NO_POSITION)
+            {
+                book.head = position;
+            }
+            else
+            {
+                (*this)[book.tail].nextInBook = position;
+            }
+            book.tail = position;
+            ++book.orders;
+            (order.side == Side::Buy ? book.buyQty : book.sellQty) += order.qty;
+            return position;
+        }
+
+        // removes the entry at `position` and returns the order index of the entry moved into it, which is
+        // the removed order itself when it was the last entry
+        uint64_t remove(uint32_t position) noexcept
+        {
+            auto& hole{(*this)[position]};
+            {
+                auto& book{_bookOf(hole.company)};
+                _unlink(book, hole);
+                --book.orders;
+                (hole.side == Side::Buy ? book.buyQty : book.sellQty) -= hole.qty;
+            }
+
+            const auto last{m_size - 1};
+            if (position != last)
+            {
+                hole = (*this)[last];
+                auto& book{_bookOf(hole.company)};
+                (hole.prevInBook == NO_POSITION ? book.head : (*this)[hole.prevInBook].nextInBook) = position;
+                (hole.nextInBook == NO_POSITION ? book.tail : (*this)[hole.nextInBook].prevInBook) = position;
+            }
+            const auto moved{hole.orderIndex};
+            --m_size;
+            _releaseSpareChunk();
+            return moved;
+        }
+
+        // frees every chunk past the last entry and the books of the companies without orders, an empty
+        // segment holds no memory at all
+        void shrinkToFit()
+        {
+            while (!m_chunks.empty() && m_size + CHUNK_ENTRIES <= capacity())
+            {
+                m_chunks.pop_back();
+            }
+            m_chunks.shrink_to_fit();
+
+            std::size_t liveBooks{0};
+            forEachBook([&](const CompanyBook& book) { liveBooks += book.orders != 0; });
+            _rehashBooks(liveBooks, true);
+        }
+
+        // the book of `company`, nullptr when the company never traded the security since the last shrink
+        [[nodiscard]] const CompanyBook* book(Symbol company) const noexcept
+        {
+            const auto slot{_findBook(company)};
+            return slot == m_books.size() ? nullptr : &m_books[slot];
+        }
+
+        // visits the books in table order, drained books included
+        template <typename F>
+        void forEachBook(F&& f) const
+        {
+            for (const auto& book : m_books)
+            {
+                if (book.company != NO_SYMBOL)
+                {
+                    f(book);
+                }
+            }
+        }
+
+        [[nodiscard]] std::size_t books() const noexcept { return m_bookCount; }
+
+        // threaded through the books by the storage while the company has orders here, the book must exist
+        [[nodiscard]] SecurityLinks& securityLinks(Symbol company) noexcept
+        {
+            return _bookOf(company).securityLinks;
+        }
+
+        [[nodiscard]] HotOrder& operator[](uint32_t position) noexcept
+        {
+            return m_chunks[position / CHUNK_ENTRIES][position % CHUNK_ENTRIES];
+        }
+
+        [[nodiscard]] const HotOrder& operator[](uint32_t position) const noexcept
+        {
+            return m_chunks[position / CHUNK_ENTRIES][position % CHUNK_ENTRIES];
+        }
+
+        // visits every entry chunk by chunk, the inner loop is a plain array walk
+        template <typename F>
+        void forEach(F&& f) const
+        {
+            uint32_t remaining{m_size};
+            for (const auto& chunk : m_chunks)
+            {
+                const auto count{remaining < CHUNK_ENTRIES ? remaining : CHUNK_ENTRIES};
+                for (uint32_t i = 0; i < count; ++i)
+                {
+                    f(chunk[i]);
+                }
+                remaining -= count;
+                if (remaining == 0)
+                {
+                    break;
+                }
+            }
+        }
+
+        [[nodiscard]] uint32_t size() const noexcept { return m_size; }
+
+        [[nodiscard]] bool empty() const noexcept { return m_size == 0; }
+
+        [[nodiscard]] std::size_t capacity() const noexcept { return m_chunks.size() * CHUNK_ENTRIES; }
+
+        [[nodiscard]] std::size_t memoryUsage() const noexcept
+        {
+            return memory::vectorHeapBytes(m_chunks) +
+                m_chunks.size() * memory::heapBlockBytes(CHUNK_ENTRIES * sizeof(HotOrder));
+        }
+
+        [[nodiscard]] std::size_t bookMemory() const noexcept
+        {
+            return memory::vectorHeapBytes(m_books);
+        }
+
+    private:
+        static constexpr std::size_t MIN_BOOK_SLOTS{8};
+
+        std::vector<std::unique_ptr<HotOrder[]>> m_chunks;
+        uint32_t m_size{0};
+        // open addressing on the company symbol, at most half full, NO_SYMBOL marks an empty slot
+        std::vector<CompanyBook> m_books;
+        std::size_t m_bookCount{0};
+
+        [[nodiscard]] std::size_t _homeSlot(Symbol company) const noexcept
+        {
+            return static_cast<std::size_t>((company * 0x9E3779B97F4A7C15ULL) >> 32) & (m_books.size() - 1);
+        }
+
+        // slot of the book of `company`, the table size when it has none
+        [[nodiscard]] std::size_t _findBook(Symbol company) const noexcept
+        {
+            if (m_books.empty())
+            {
+                return 0;
+            }
+            for (auto slot{_homeSlot(company)};; slot = (slot + 1) & (m_books.size() - 1))
+            {
+                const auto bookCompany{m_books[slot].company};
+                if (bookCompany == company)
+                {
+                    return slot;
+                }
+                if (bookCompany == NO_SYMBOL)
+                {
+                    return m_books.size();
+                }
+            }
+        }
+
+        // the order is in the segment, so its book is too
+        [[nodiscard]] CompanyBook& _bookOf(Symbol company) noexcept { return m_books[_findBook(company)]; }
+
+        CompanyBook& _findOrAddBook(Symbol company)
+        {
+            if (const auto slot{_findBook(company)}; slot != m_books.size())
+            {
+                return m_books[slot];
+            }
+            if ((m_bookCount + 1) * 2 > m_books.size())
+            {
+                _rehashBooks(m_bookCount + 1, false);
+            }
+            ++m_bookCount;
+            return _insertBook(CompanyBook{company});
+        }
+
+        CompanyBook& _insertBook(const CompanyBook& book) noexcept
+        {
+            auto slot{_homeSlot(book.company)};
+            while (m_books[slot].company != NO_SYMBOL)
+            {
+                slot = (slot + 1) & (m_books.size() - 1);
+            }
+            return m_books[slot] = book;
+        }
+
+        // sizes the table for `books` books, at most half full
+        void _rehashBooks(std::size_t books, bool dropDrained)
+        {
+            auto slots{MIN_BOOK_SLOTS};
+            while (slots < books * 2)
+            {
+                slots *= 2;
+            }
+            auto old{std::exchange(m_books, std::vector<CompanyBook>(books == 0 ? 0 : slots, CompanyBook{NO_SYMBOL}))};
+            m_bookCount = 0;
+            for (const auto& book : old)
+            {
+                if (book.company != NO_SYMBOL && (!dropDrained || book.orders != 0))
+                {
+                    _insertBook(book);
+                    ++m_bookCount;
+                }
+            }
+        }
+
+        void _unlink(CompanyBook& book, const HotOrder& entry) noexcept
+        {
+            (entry.prevInBook == NO_POSITION ? book.head : (*this)[entry.prevInBook].nextInBook) = entry.nextInBook;
+            (entry.nextInBook == NO_POSITION ? book.tail : (*this)[entry.nextInBook].prevInBook) = entry.prevInBook;
+        }
+
+        // keeps one empty chunk as hysteresis so add/cancel at a chunk boundary does not thrash
+        void _releaseSpareChunk() noexcept
+        {
+            if (m_chunks.size() >= 2 && m_size + 2 * CHUNK_ENTRIES <= capacity())
+            {
+                m_chunks.pop_back();
+            }
+        }
+    };
+}
@@ -0,0 +1,80 @@
+#pragma once
+
+#include "FlatHashMap.h"
+#include "MemoryUsage.h"
+
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace order_cache::storage
+{
+    using Symbol = uint32_t;
+
+    static constexpr Symbol NO_SYMBOL{~Symbol{0}};
+
+    // Interns names into dense 32-bit symbols, rank i is the i-th distinct name seen. Symbols are never
+    // released: securities and companies are small, long lived domains.
+    class SymbolTable final
+    {
+    public:
+        using Map = FlatHashMap<Symbol>;
+
+        explicit SymbolTable(std::size_t expectedSymbols = 0)
+        {
+            m_symbols.reserve(expectedSymbols);
+            m_names.reserve(expectedSymbols);
+        }
+
+        SymbolTable(const SymbolTable&) = delete;
+        SymbolTable& operator=(const SymbolTable&) = delete;
+
+        void reserve(std::size_t expectedSymbols)
+        {
+            m_symbols.reserve(expectedSymbols);
+            m_names.reserve(expectedSymbols);
+        }
+
+        [[nodiscard]] Symbol intern(std::string_view name)
+        {
+            const auto [symbol, inserted]{m_symbols.tryEmplace(name)};
+            if (inserted)
+            {
+                // the map moves its keys around, names handed out view copies that never move
+                *symbol = static_cast<Symbol>(m_names.size());
+                m_names.emplace_back(std::make_unique<const std::string>(name));
+            }
+            return *symbol;
+        }
+
+        [[nodiscard]] std::optional<Symbol> find(std::string_view name) const
+        {
+            const auto* symbol{m_symbols.find(name)};
+            return symbol == nullptr ? std::nullopt : std::optional<Symbol>{*symbol};
+        }
+
+        [[nodiscard]] std::string_view name(Symbol symbol) const noexcept { return *m_names[symbol]; }
+
+        [[nodiscard]] std::size_t size() const noexcept { return m_names.size(); }
+
+        [[nodiscard]] const Map& map() const noexcept { return m_symbols; }
+
+        [[nodiscard]] std::size_t memoryUsage() const noexcept
+        {
+            auto bytes{m_symbols.slotMemory() + m_symbols.keyMemory()};
+            bytes += memory::vectorHeapBytes(m_names);
+            for (const auto& name : m_names)
+            {
+                bytes += memory::heapBlockBytes(sizeof(std::string)) + memory::stringHeapBytes(*name);
+            }
+            return bytes;
+        }
+
+    private:
+        Map m_symbols;
+        std::vector<std::unique_ptr<const std::string>> m_names;
+    };
+}
@@ -0,0 +1,220 @@
+#pragma once
+
+#include "LatencyHistogram.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <ios>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <vector>
+
+namespace order_cache::trace
+{
+#ifdef ORDER_CACHE_TRACING
+    static constexpr bool TRACING_ENABLED{true};
+#else
+    static constexpr bool TRACING_ENABLED{false};
+#endif
+
+    // One completed span, timestamps are raw LatencyClock ticks converted on export
+    struct TraceEvent
+    {
+        const char* name{nullptr}; // string literal, never owned
+        uint64_t startTicks{0};
+        uint64_t endTicks{0};
+    };
+
+    // Fixed size ring of the most recent spans of one thread, older spans are overwritten
+    class TraceBuffer final
+    {
+    public:
+        static constexpr std::size_t DEFAULT_CAPACITY{1u << 20};
+
+        explicit TraceBuffer(uint32_t threadId, std::size_t capacity = DEFAULT_CAPACITY)
+            : m_events(_roundUpToPowerOfTwo(capacity)),
+              m_mask(m_events.size() - 1),
+              m_threadId(threadId)
+        {
+        }
+
+        void record(const char* name, uint64_t startTicks, uint64_t endTicks) noexcept
+        {
+            m_events[m_next++ & m_mask] = TraceEvent{name, startTicks, endTicks};
+        }
+
+        void clear() noexcept { m_next = 0; }
+
+        // spans ever recorded, including the overwritten ones
+        [[nodiscard]] uint64_t recorded() const noexcept { return m_next; }
+
+        [[nodiscard]] std::size_t size() const noexcept
+        {
+            return static_cast<std::size_t>(std::min<uint64_t>(m_next, m_events.size()));
+        }
+
+        [[nodiscard]] std::size_t capacity() const noexcept { return m_events.size(); }
+
+        [[nodiscard]] uint32_t threadId() const noexcept { return m_threadId; }
+
+        // i-th retained span, oldest first
+        [[nodiscard]] const TraceEvent& operator[](std::size_t i) const noexcept
+        {
+            return m_events[(m_next - size() + i) & m_mask];
+        }
+
+    private:
+        std::vector<TraceEvent> m_events;
+        uint64_t m_mask;
+        uint64_t m_next{0};
+        uint32_t m_threadId;
+
+        [[nodiscard]] static std::size_t _roundUpToPowerOfTwo(std::size_t value) noexcept
+        {
+            std::size_t result{1};
+            while (result < value)
+            {
+                result <<= 1;
+            }
+            return result;
+        }
+    };
+
+    // Owns the buffers of every thread that traced, so they can be exported after the threads exit.
+    // Exporting or clearing while other threads still record is not synchronised.
+    class TraceRegistry final
+    {
+    public:
+        [[nodiscard]] static TraceRegistry& instance()
+        {
+            static TraceRegistry registry;
+            return registry;
+        }
+
+        // the calling thread's buffer, allocated on its first span
+        [[nodiscard]] static TraceBuffer& threadBuffer()
+        {
+            thread_local TraceBuffer* buffer{instance()._createBuffer()};
+            return *buffer;
+        }
+
+        void clear()
+        {
+            std::lock_guard lock{m_mutex};
+            for (auto& buffer : m_buffers)
+            {
+                buffer->clear();
+            }
+        }
+
+        [[nodiscard]] uint64_t recorded() const
+        {
+            std::lock_guard lock{m_mutex};
+            uint64_t total{0};
+            for (const auto& buffer : m_buffers)
+            {
+                total += buffer->recorded();
+            }
+            return total;
+        }
+
+        void writeChromeTrace(std::ostream& os) const;
+
+    private:
+        mutable std::mutex m_mutex;
+        std::vector<std::unique_ptr<TraceBuffer>> m_buffers;
+
+        TraceBuffer* _createBuffer()
+        {
+            std::lock_guard lock{m_mutex};
+            m_buffers.emplace_back(std::make_unique<TraceBuffer>(static_cast<uint32_t>(m_buffers.size() + 1)));
+            return m_buffers.back().get();
+        }
+    };
+
+    // Chrome trace-event JSON ("X" complete events, microsecond timestamps) of the given buffers,
+    // loadable in chrome://tracing and Perfetto
+    inline void writeChromeTrace(std::ostream& os, const std::vector<const TraceBuffer*>& buffers)
+    {
+        uint64_t origin{UINT64_MAX};
+        for (const auto* buffer : buffers)
+        {
+            if (buffer->size() != 0)
+            {
+                origin = std::min(origin, (*buffer)[0].startTicks);
+            }
+        }
+
+        const auto micros{
+            [origin](uint64_t ticks)
+            {
+                return static_cast<double>(metrics::LatencyClock::toNs(ticks - origin)) / 1000.0;
+            }
+        };
+
+        os << "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[";
+        bool first{true};
+        const auto precision{os.precision(3)};
+        const auto flags{os.setf(std::ios::fixed, std::ios::floatfield)};
+        for (const auto* buffer : buffers)
+        {
+            for (std::size_t i = 0; i < buffer->size(); ++i)
+            {
+                const auto& event{(*buffer)[i]};
+                os << (first ? "\n" : ",\n")
+                    << R"({"name":")" << event.name << R"(","cat":"order_cache","ph":"X","pid":1,"tid":)"
+                    << buffer->threadId() << ",\"ts\":" << micros(event.startTicks)
+                    << ",\"dur\":" << micros(event.endTicks) - micros(event.startTicks) << '}';
+                first = false;
+            }
+        }
+        os.flags(flags);
+        os.precision(precision);
+        os << "\n]}\n";
+    }
+
+    inline void TraceRegistry::writeChromeTrace(std::ostream& os) const
+    {
+        std::lock_guard lock{m_mutex};
+        std::vector<const TraceBuffer*> buffers;
+        for (const auto& buffer : m_buffers)
+        {
+            buffers.emplace_back(buffer.get());
+        }
+        trace::writeChromeTrace(os, buffers);
+    }
+
+    // Records the lifetime of the guard as a span of the calling thread, compiles to nothing when disabled
+    template <bool Enabled = TRACING_ENABLED>
+    class ScopedTrace final
+    {
+    public:
+        explicit ScopedTrace(const char* name) noexcept
+            : m_name(name),
+              m_start(metrics::LatencyClock::ticks())
+        {
+        }
+
+        ScopedTrace(const ScopedTrace&) = delete;
+        ScopedTrace& operator=(const ScopedTrace&) = delete;
+
+        ~ScopedTrace()
+        {
+            TraceRegistry::threadBuffer().record(m_name, m_start, metrics::LatencyClock::ticks());
+        }
+
+    private:
+        const char* m_name;
+        uint64_t m_start;
+    };
+
+    template <>
+    class ScopedTrace<false> final
+    {
+    public:
+        explicit ScopedTrace(const char*) noexcept
+        {
+        }
+    };
+}
@@ -0,0 +1,249 @@
+#pragma once
+
+#include "OrderCache.h"
+#include "OrderGenerator.h"
+
+#include <cmath>
+#include <cstdint>
+#include <functional>
+#include <queue>
+#include <string>
+#include <vector>
+
+namespace order_cache::workload
+{
+    enum class OperationType : uint32_t
+    {
+        Add = 0,
+        Cancel,
+        Amend, // cancel/replace: the old order is cancelled and a new order id takes its place
+        CancelUser,
+        CancelMinQty,
+        Match,
+    };
+
+    [[nodiscard]] inline const char* operationName(OperationType type) noexcept
+    {
+        switch (type)
+        {
+        case OperationType::Add: return "add";
+        case OperationType::Cancel: return "cancel";
+        case OperationType::Amend: return "amend";
+        case OperationType::CancelUser: return "cancel_user";
+        case OperationType::CancelMinQty: return "cancel_min_qty";
+        case OperationType::Match: return "match";
+        default: return "unknown";
+        }
+    }
+
+    struct Operation
+    {
+        OperationType type{OperationType::Add};
+        uint32_t orderIndex{0}; // Add, Amend: order to insert, index into OperationStream::orders
+        std::string key{}; // Cancel, Amend: order id to cancel; CancelUser: user; CancelMinQty, Match: security
+        unsigned int minQty{0}; // CancelMinQty only
+    };
+
+    struct OperationStream
+    {
+        std::vector<Order> orders;
+        std::vector<Operation> operations;
+    };
+
+    enum class LifetimeDistribution : uint32_t
+    {
+        Exponential = 0, // memoryless, most orders die young
+        Pareto, // heavy tail, a few orders rest on the book for very long
+        Fixed,
+    };
+
+    // Relative weights of the spontaneous operations, single cancels and amends are not drawn here,
+    // they happen when an order reaches the end of its lifetime.
+    struct OperationMix
+    {
+        double add{60};
+        double match{10};
+        double cancelUser{0.1};
+        double cancelMinQty{1};
+    };
+
+    struct LifecycleConfig
+    {
+        GeneratorConfig orders{};
+        OperationMix mix{};
+
+        // lifetime measured in emitted operations
+        LifetimeDistribution lifetime{LifetimeDistribution::Exponential};
+        double meanLifetime{20'000};
+        double paretoShape{1.5};
+
+        // share of expiring orders that are amended (cancel/replace) instead of cancelled
+        double amendRatio{0.2};
+
+        // the stream starts with this many adds so that it measures a book in steady state
+        std::size_t initialOrders{0};
+    };
+
+    // Emits an interleaved stream of adds, cancels, amends, bulk cancels and matching queries. Every added
+    // order gets a lifetime and is cancelled or amended once it expires, so the book reaches a steady state
+    // of about mix.add / total * meanLifetime live orders. Bulk cancels are not tracked, a later scheduled
+    // cancel of an order they already removed is replayed as a cancel of an unknown id.
+    class LifecycleGenerator final
+    {
+    public:
+        explicit LifecycleGenerator(const LifecycleConfig& config)
+            : m_config(config),
+              m_orderGenerator(config.orders)
+        {
+        }
+
+        [[nodiscard]] OperationStream generate(std::size_t numOperations)
+        {
+            OperationStream stream;
+            stream.operations.reserve(numOperations + m_config.initialOrders);
+
+            for (std::size_t i = 0; i < m_config.initialOrders; ++i)
+            {
+                _emitAdd(stream, OperationType::Add, {});
+            }
+
+            const auto& mix{m_config.mix};
+            const auto total{mix.add + mix.match + mix.cancelUser + mix.cancelMinQty};
+            for (std::size_t i = 0; i < numOperations; ++i)
+            {
+                if (!m_expiries.empty() && m_expiries.top().at <= m_now)
+                {
+                    _expire(stream);
+                    continue;
+                }
+
+                auto pick{uniformUnit(m_orderGenerator.random()) * total};
+                if ((pick -= mix.add) < 0)
+                {
+                    _emitAdd(stream, OperationType::Add, {});
+                }
+                else if ((pick -= mix.match) < 0)
+                {
+                    _emit(stream, {OperationType::Match, 0, m_orderGenerator.pickSecurity()});
+                }
+                else if ((pick -= mix.cancelUser) < 0)
+                {
+                    _emit(stream, {OperationType::CancelUser, 0, m_orderGenerator.pickUser()});
+                }
+                else
+                {
+                    _emit(stream, {
+                              OperationType::CancelMinQty, 0, m_orderGenerator.pickSecurity(),
+                              m_orderGenerator.nextQty()
+                          });
+                }
+            }
+            return stream;
+        }
+
+        [[nodiscard]] const OrderGenerator& orderGenerator() const noexcept { return m_orderGenerator; }
+
+    private:
+        struct Expiry
+        {
+            uint64_t at{0};
+            uint32_t orderIndex{0};
+
+            bool operator>(const Expiry& other) const noexcept { return at > other.at; }
+        };
+
+        LifecycleConfig m_config;
+        OrderGenerator m_orderGenerator;
+        std::priority_queue<Expiry, std::vector<Expiry>, std::greater<>> m_expiries;
+        uint64_t m_now{0};
+
+        void _emit(OperationStream& stream, Operation&& op)
+        {
+            stream.operations.emplace_back(std::move(op));
+            ++m_now;
+        }
+
+        void _emitAdd(OperationStream& stream, OperationType type, std::string replacedOrderId)
+        {
+            const auto orderIndex{static_cast<uint32_t>(stream.orders.size())};
+            stream.orders.emplace_back(m_orderGenerator.next());
+            m_expiries.push({m_now + _nextLifetime(), orderIndex});
+            _emit(stream, {type, orderIndex, std::move(replacedOrderId)});
+        }
+
+        void _expire(OperationStream& stream)
+        {
+            const auto expiring{m_expiries.top()};
+            m_expiries.pop();
+
+            auto orderId{stream.orders[expiring.orderIndex].orderId()};
+            if (uniformUnit(m_orderGenerator.random()) < m_config.amendRatio)
+            {
+                _emitAdd(stream, OperationType::Amend, std::move(orderId));
+            }
+            else
+            {
+                _emit(stream, {OperationType::Cancel, 0, std::move(orderId)});
+            }
+        }
+
+        [[nodiscard]] uint64_t _nextLifetime()
+        {
+            const auto mean{std::max(m_config.meanLifetime, 1.0)};
+            const auto u{1.0 - uniformUnit(m_orderGenerator.random())}; // (0, 1]
+            double lifetime{mean};
+            switch (m_config.lifetime)
+            {
+            case LifetimeDistribution::Exponential:
+                lifetime = -std::log(u) * mean;
+                break;
+            case LifetimeDistribution::Pareto:
+                {
+                    // scale chosen so that the distribution mean equals meanLifetime
+                    const auto shape{std::max(m_config.paretoShape, 1.01)};
+                    const auto scale{mean * (shape - 1.0) / shape};
+                    lifetime = scale / std::pow(u, 1.0 / shape);
+                    break;
+                }
+            case LifetimeDistribution::Fixed:
+                break;
+            }
+            return static_cast<uint64_t>(lifetime) + 1;
+        }
+    };
+
+    // Applies one operation of the stream to the cache
+    inline void apply(OrderCacheInterface& cache, const OperationStream& stream, const Operation& op)
+    {
+        switch (op.type)
+        {
+        case OperationType::Add:
+            cache.addOrder(stream.orders[op.orderIndex]);
+            break;
+        case OperationType::Cancel:
+            cache.cancelOrder(op.key);
+            break;
+        case OperationType::Amend:
+            cache.cancelOrder(op.key);
+            cache.addOrder(stream.orders[op.orderIndex]);
+            break;
+        case OperationType::CancelUser:
+            cache.cancelOrdersForUser(op.key);
+            break;
+        case OperationType::CancelMinQty:
+            cache.cancelOrdersForSecIdWithMinimumQty(op.key, op.minQty);
+            break;
+        case OperationType::Match:
+            cache.getMatchingSizeForSecurity(op.key);
+            break;
+        }
+    }
+
+    inline void replay(OrderCacheInterface& cache, const OperationStream& stream)
+    {
+        for (const auto& op : stream.operations)
+        {
+            apply(cache, stream, op);
+        }
+    }
+}